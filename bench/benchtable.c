@@ -0,0 +1,127 @@
+/*
+ *    table - Command line utility to format and display CSV.
+ *    Copyright (C) 2020  Страхиња Радић
+ *
+ *    This program is free software: you can redistribute it and/or modify it
+ *    under the terms of the GNU General Public License as published by the Free
+ *    Software Foundation, either version 3 of the License, or (at your option)
+ *    any later version.
+ *
+ *    This program is distributed in the hope that it will be useful, but
+ *    WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *    or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *    for more details.
+ *
+ *    You should have received a copy of the GNU General Public License along
+ *    with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Runs table once on a file and measures it: wall time, time until the
+ * first rendered byte arrives, peak resident set size, and the number of
+ * rows rendered (output lines less the borders and the header). Prints one
+ * CSV line: seconds,first_row_ms,rss_kb,rows. table's output goes through
+ * a pipe, so it buffers output the way it would in a shell pipeline.
+ */
+
+#define _DEFAULT_SOURCE
+#include "../defs.h"
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+static double
+elapsed(const struct timespec* start)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec)
+        + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+int
+main(int argc, char** argv)
+{
+    uint8_t buffer[64 * 1024];
+    struct timespec start;
+    struct rusage usage;
+    double first_row = -1;
+    size_t lines = 0;
+    ssize_t got;
+    int status;
+    int fds[2];
+    pid_t pid;
+
+    if (argc < 3)
+    {
+        fprintf(stderr, "Usage: benchtable <table> <file> [<option>...]\n");
+        return 1;
+    }
+
+    if (pipe(fds))
+    {
+        perror("pipe");
+        return 1;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    pid = fork();
+    if (pid < 0)
+    {
+        perror("fork");
+        return 1;
+    }
+    if (pid == 0)
+    {
+        char** args = NULL;
+
+        /* table <options> <file> */
+        CALLOC(args, char*, argc)
+        args[0] = argv[1];
+        for (int i = 3; i < argc; i++)
+            args[i-2] = argv[i];
+        args[argc-2] = argv[2];
+        dup2(fds[1], STDOUT_FILENO);
+        close(fds[0]);
+        close(fds[1]);
+        execv(argv[1], args);
+        perror(argv[1]);
+        _exit(127);
+    }
+    close(fds[1]);
+
+    while ((got = read(fds[0], buffer, sizeof(buffer))) != 0)
+    {
+        if (got < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            perror("read");
+            return 1;
+        }
+        if (first_row < 0)
+            first_row = elapsed(&start);
+        for (uint8_t* p = buffer; (p = memchr(p, '\n', buffer + got - p));
+                p++)
+            lines++;
+    }
+    close(fds[0]);
+
+    if (wait4(pid, &status, 0, &usage) < 0)
+    {
+        perror("wait4");
+        return 1;
+    }
+    if (!WIFEXITED(status) || WEXITSTATUS(status))
+    {
+        fprintf(stderr, "benchtable: %s failed\n", argv[1]);
+        return 1;
+    }
+
+    printf("%.6f,%.3f,%ld,%zu\n", elapsed(&start),
+            first_row < 0 ? 0 : first_row * 1000, usage.ru_maxrss,
+            lines > 3 ? lines - 3 : 0);
+
+    return 0;
+}
@@ -0,0 +1,157 @@
+/*
+ *    table - Command line utility to format and display CSV.
+ *    Copyright (C) 2020  Страхиња Радић
+ *
+ *    This program is free software: you can redistribute it and/or modify it
+ *    under the terms of the GNU General Public License as published by the Free
+ *    Software Foundation, either version 3 of the License, or (at your option)
+ *    any later version.
+ *
+ *    This program is distributed in the hope that it will be useful, but
+ *    WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *    or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *    for more details.
+ *
+ *    You should have received a copy of the GNU General Public License along
+ *    with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Deterministic CSV generator for the benchmarks. The same arguments always
+ * give the same file, so results can be compared between builds and
+ * machines. Field lengths are spread evenly around the requested width;
+ * the given percentages of fields hold non-ASCII text, quotes (with
+ * delimiters and doubled quotes inside) or tabs.
+ */
+
+#include "../defs.h"
+
+static uint64_t state = 1;
+
+/* xorshift64* */
+static uint64_t
+next_random()
+{
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+    return state * 0x2545F4914F6CDD1DULL;
+}
+
+static size_t
+random_below(size_t n)
+{
+    return n ? (next_random() >> 33) % n : 0;
+}
+
+/* Two-byte Cyrillic, three-byte CJK (two columns wide) and four-byte emoji */
+static const char* utf8_chars[] =
+{
+    "ж", "љ", "ђ", "ш", "я", "表", "格", "字", "段", "😀", "🚀", "é", "ß"
+};
+
+static void
+write_field(size_t width, UINT utf8_pct, UINT quote_pct, UINT tab_pct)
+{
+    size_t length = 1 + random_below(2 * width - 1);
+    BOOL utf8 = random_below(100) < utf8_pct;
+    BOOL quoted = random_below(100) < quote_pct;
+    BOOL tabs = random_below(100) < tab_pct;
+
+    if (quoted)
+        putchar('"');
+    for (size_t i = 0; i < length; i++)
+    {
+        size_t r = random_below(64);
+
+        if (quoted && r == 0)
+            fputs("\"\"", stdout);
+        else if (quoted && r == 1)
+            putchar(',');
+        else if (tabs && r < 8)
+            putchar('\t');
+        else if (utf8 && r < 48)
+            fputs(utf8_chars[random_below(sizeof(utf8_chars)
+                        / sizeof(*utf8_chars))], stdout);
+        else if (r < 56)
+            putchar('a' + random_below(26));
+        else
+            putchar('0' + random_below(10));
+    }
+    if (quoted)
+        putchar('"');
+}
+
+static int
+usage()
+{
+    fprintf(stderr, "Usage: mkcsv [-r <rows>] [-c <columns>] [-w <width>]"
+            " [-u <utf8%%>] [-q <quoted%%>] [-t <tabs%%>] [-s <seed>]\n");
+    return 1;
+}
+
+int
+main(int argc, char** argv)
+{
+    size_t rows = 100000;
+    size_t columns = 8;
+    size_t width = 8;
+    UINT utf8_pct = 0;
+    UINT quote_pct = 0;
+    UINT tab_pct = 0;
+    char* arg;
+
+    while ((arg = *++argv))
+    {
+        char* value = *(argv+1);
+
+        if (*arg != '-' || !*(arg+1) || *(arg+2) || !value)
+            return usage();
+        switch (*(arg+1))
+        {
+        case 'r':
+            rows = strtoul(value, NULL, 10);
+            break;
+        case 'c':
+            columns = strtoul(value, NULL, 10);
+            break;
+        case 'w':
+            width = strtoul(value, NULL, 10);
+            break;
+        case 'u':
+            utf8_pct = strtoul(value, NULL, 10);
+            break;
+        case 'q':
+            quote_pct = strtoul(value, NULL, 10);
+            break;
+        case 't':
+            tab_pct = strtoul(value, NULL, 10);
+            break;
+        case 's':
+            state = strtoull(value, NULL, 10);
+            break;
+        default:
+            return usage();
+        }
+        argv++;
+    }
+    if (!columns || !width || !state)
+        return usage();
+
+    for (size_t c = 0; c < columns; c++)
+        printf("%scol%zu", c ? "," : "", c + 1);
+    putchar('\n');
+    for (size_t r = 0; r < rows; r++)
+    {
+        for (size_t c = 0; c < columns; c++)
+        {
+            if (c)
+                putchar(',');
+            write_field(width, utf8_pct, quote_pct, tab_pct);
+        }
+        putchar('\n');
+    }
+
+    return ferror(stdout) ? 1 : 0;
+}
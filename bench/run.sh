@@ -0,0 +1,104 @@
+#!/bin/sh
+#
+# Benchmark harness: runs table on every workload in bench/workloads and
+# reports throughput (MB/s, rows/s), peak RSS and time to the first row,
+# each against bench/baseline.csv if it exists. Exits with 1 if anything
+# regressed by more than BENCH_TOLERANCE percent (default 10).
+#
+# Usage: run.sh [-s] <table>
+#   -s  save the results as the new baseline
+#
+# BENCH_RUNS (default 3) sets the number of runs per workload; the best
+# time and the highest RSS are kept. Data is generated into bench/data on
+# first use.
+
+SAVE=
+if [ "$1" = "-s" ]; then
+    SAVE=1
+    shift
+fi
+if [ $# -ne 1 ]; then
+    echo "Usage: $0 [-s] <table>" >&2
+    exit 1
+fi
+
+case $1 in
+    /*) TABLE=$1 ;;
+    *)  TABLE=$PWD/$1 ;;
+esac
+cd "$(dirname "$0")" || exit 1
+RUNS=${BENCH_RUNS:-3}
+TOLERANCE=${BENCH_TOLERANCE:-10}
+RESULTS=data/results.csv
+
+mkdir -p data
+: >$RESULTS
+
+grep -v '^#' workloads | while IFS='|' read -r name gen opts; do
+    name=$(echo $name)
+    [ -n "$name" ] || continue
+    data=data/$name.csv
+
+    # Regenerate when the arguments in workloads change
+    if [ ! -f $data ] || [ "$(cat data/$name.args 2>/dev/null)" != "$gen" ]
+    then
+        echo "Generating $data" >&2
+        ./mkcsv $gen >$data || exit 1
+        echo "$gen" >data/$name.args
+    fi
+
+    i=0
+    while [ $i -lt $RUNS ]; do
+        ./benchtable "$TABLE" $data $opts || exit 1
+        i=$((i+1))
+    done | awk -F, -v name=$name -v bytes=$(wc -c <$data) '
+        NR == 1 || $1 < time  { time = $1 }
+        NR == 1 || $2 < first { first = $2 }
+        $3 > rss              { rss = $3 }
+                              { rows = $4 }
+        END {
+            printf "%s,%.1f,%.0f,%d,%.1f\n", name, bytes / time / 1e6,
+                rows / time, rss, first
+        }' >>$RESULTS || exit 1
+done || exit 1
+
+if [ -n "$SAVE" ]; then
+    cp $RESULTS baseline.csv
+    echo "Saved baseline.csv" >&2
+fi
+
+# Lower is better for RSS and time to first row; changes to the latter
+# under 5 ms are noise
+awk -F, -v tolerance=$TOLERANCE '
+    function change(new, old) {
+        return old ? sprintf("%+.1f%%", (new - old) * 100 / old) : ""
+    }
+    FILENAME != ARGV[ARGC-1] {
+        mbps[$1] = $2; rows[$1] = $3; rss[$1] = $4; first[$1] = $5
+        next
+    }
+    FNR == 1 {
+        print "workload,MB/s,vs base,rows/s,vs base,peak RSS (KB),vs base," \
+            "first row (ms),vs base,status"
+    }
+    {
+        status = ($1 in mbps) ? "ok" : "no baseline"
+        if (($1 in mbps) && ($2 < mbps[$1] * (1 - tolerance / 100) \
+                || $3 < rows[$1] * (1 - tolerance / 100) \
+                || $4 > rss[$1] * (1 + tolerance / 100) \
+                || ($5 > first[$1] * (1 + tolerance / 100) \
+                    && $5 - first[$1] > 5)))
+        {
+            status = "REGRESSION"
+            regressed = 1
+        }
+        print $1 "," $2 "," change($2, mbps[$1]) "," $3 "," \
+            change($3, rows[$1]) "," $4 "," change($4, rss[$1]) "," $5 "," \
+            change($5, first[$1]) "," status
+    }
+    END { exit regressed }
+' $([ -f baseline.csv ] && echo baseline.csv) $RESULTS >data/report.csv
+status=$?
+
+"$TABLE" -a -n -c 150 -s ss data/report.csv
+exit $status
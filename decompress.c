@@ -0,0 +1,494 @@
+/*
+ *    table - Command line utility to format and display CSV.
+ *    Copyright (C) 2020  Страхиња Радић
+ *
+ *    This program is free software: you can redistribute it and/or modify it
+ *    under the terms of the GNU General Public License as published by the Free
+ *    Software Foundation, either version 3 of the License, or (at your option)
+ *    any later version.
+ *
+ *    This program is distributed in the hope that it will be useful, but
+ *    WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *    or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *    for more details.
+ *
+ *    You should have received a copy of the GNU General Public License along
+ *    with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "decompress.h"
+
+#ifdef TABLE_GZIP
+#include <zlib.h>
+#endif
+#ifdef TABLE_XZ
+#include <lzma.h>
+#endif
+#ifdef TABLE_ZSTD
+#include <zstd.h>
+#endif
+
+#if defined(TABLE_GZIP) || defined(TABLE_XZ) || defined(TABLE_ZSTD)
+#define TABLE_CODECS
+#endif
+
+/* How often a producer waiting for a stream checks whether to stop, in ms */
+#define DECOMPRESS_POLL 100
+
+/*
+ * Compressed data to decompress: a mapped file, or the first bytes of a
+ * stream (already read by the reader, to tell the format) followed by the
+ * rest of it. Owned by the producer, which frees it when done.
+ */
+typedef struct
+{
+    int      codec;
+    int      fd;       /* rest of the stream, or -1 */
+    uint8_t* data;     /* compressed bytes not yet handed out */
+    size_t   length;
+    uint8_t* mapping;  /* mapped file, unmapped when done */
+    size_t   size;
+    uint8_t* buffer;   /* for reads from fd */
+} Source;
+
+/* Bytes each compression format starts with */
+static const struct
+{
+    int            codec;
+    const uint8_t* magic;
+    size_t         length;
+} magics[] =
+{
+    { CODEC_GZIP, (const uint8_t*)"\x1f\x8b", 2 },
+    { CODEC_XZ, (const uint8_t*)"\xfd" "7zXZ\0", 6 },
+    { CODEC_ZSTD, (const uint8_t*)"\x28\xb5\x2f\xfd", 4 }
+};
+
+/*
+ * Tell the compression format of data from its first bytes. Returns -1 if
+ * there are too few of them to tell yet.
+ */
+int
+codec_detect(const uint8_t* data, size_t length)
+{
+    int codec = CODEC_NONE;
+
+    for (size_t i = 0; i < sizeof(magics) / sizeof(*magics); i++)
+    {
+        size_t compared = length < magics[i].length ? length
+            : magics[i].length;
+
+        if (!memcmp(data, magics[i].magic, compared))
+        {
+            if (compared == magics[i].length)
+                return magics[i].codec;
+            codec = -1;
+        }
+    }
+    return codec;
+}
+
+const char*
+codec_name(int codec)
+{
+    return codec == CODEC_GZIP ? "gzip"
+        : codec == CODEC_XZ ? "xz"
+        : codec == CODEC_ZSTD ? "zstd"
+        : "uncompressed";
+}
+
+/* Whether this build can decompress codec */
+BOOL
+codec_supported(int codec)
+{
+    switch (codec)
+    {
+#ifdef TABLE_GZIP
+    case CODEC_GZIP:
+#endif
+#ifdef TABLE_XZ
+    case CODEC_XZ:
+#endif
+#ifdef TABLE_ZSTD
+    case CODEC_ZSTD:
+#endif
+    case CODEC_NONE:
+        return TRUE;
+    default:
+        return FALSE;
+    }
+}
+
+/*
+ * Wait for the stream to have data. Returns FALSE once the reader has
+ * stopped, so that a producer waiting on a quiet pipe can be joined.
+ */
+static BOOL
+source_ready(Ring* ring, int fd)
+{
+    struct pollfd pfd;
+    int ready;
+
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    for (;;)
+    {
+        ready = poll(&pfd, 1, DECOMPRESS_POLL);
+        if (ready > 0 || (ready < 0 && errno != EINTR))
+            return TRUE;
+        if (ring_stopping(ring))
+            return FALSE;
+    }
+}
+
+/*
+ * Whether reading more would have to wait for the stream. A block partly
+ * filled is then handed over first, for the reader not to wait with it.
+ */
+static BOOL
+source_idle(Source* source)
+{
+    struct pollfd pfd;
+
+    pfd.fd = source->fd;
+    pfd.events = POLLIN;
+    return !source->length && source->fd >= 0 && !poll(&pfd, 1, 0);
+}
+
+#ifdef TABLE_CODECS
+/*
+ * Return the next compressed bytes in *data, or 0 at their end; *code is
+ * set if they end with an error
+ */
+static size_t
+source_read(Ring* ring, Source* source, const uint8_t** data, int* code)
+{
+    ssize_t bytes_read;
+
+    if (source->length)
+    {
+        *data = source->data;
+        bytes_read = source->length;
+        source->length = 0;
+        return bytes_read;
+    }
+    if (source->fd < 0)
+        return 0;
+
+    do
+    {
+        if (!source_ready(ring, source->fd))
+            return 0;
+        bytes_read = read(source->fd, source->buffer, DECOMPRESS_READSIZE);
+    }
+    while (bytes_read < 0 && errno == EINTR);
+    if (bytes_read < 0)
+    {
+        *code = errno;
+        return 0;
+    }
+    *data = source->buffer;
+    return bytes_read;
+}
+#endif
+
+/*
+ * Uncompressed data, read ahead: the stream is read straight into the
+ * blocks, after the bytes the reader already has
+ */
+static int
+decompress_none(Ring* ring, Source* source)
+{
+    uint8_t* block = NULL;
+    size_t filled;
+    ssize_t bytes_read = 1;
+    int code = 0;
+
+    while (bytes_read > 0 && (block = ring_acquire(ring)))
+    {
+        filled = source->length;
+        memcpy(block, source->data, filled);
+        source->length = 0;
+        while (filled < RING_BLOCKSIZE && !(filled && source_idle(source)))
+        {
+            if (!source_ready(ring, source->fd))
+            {
+                bytes_read = 0;
+                break;
+            }
+            bytes_read = read(source->fd, block + filled,
+                    RING_BLOCKSIZE - filled);
+            if (bytes_read < 0 && errno == EINTR)
+                continue;
+            if (bytes_read < 0)
+                code = errno;
+            if (bytes_read <= 0)
+                break;
+            filled += bytes_read;
+        }
+        if (filled)
+            ring_commit(ring, filled);
+    }
+    return code;
+}
+
+/*
+ * Each decompressor below fills ring blocks until its input ends. More
+ * input is read only once the last call left room in the block: until
+ * then, the decompressor may still hold output for the input it has. A
+ * block is handed over before it is full when the stream has to be waited
+ * for.
+ */
+
+#ifdef TABLE_GZIP
+/* gzip, or zlib, data; members of a multi-member file are concatenated */
+static int
+decompress_gzip(Ring* ring, Source* source)
+{
+    z_stream z;
+    const uint8_t* next = NULL;
+    uint8_t* block = NULL;
+    BOOL flushed = TRUE;
+    BOOL member = FALSE;
+    BOOL end = FALSE;
+    int status;
+    int code = 0;
+
+    memset(&z, 0, sizeof(z));
+    if (inflateInit2(&z, 15 + 32) != Z_OK)
+        return ENOMEM;
+
+    while (!code && !end && (block = ring_acquire(ring)))
+    {
+        z.next_out = block;
+        z.avail_out = RING_BLOCKSIZE;
+        while (z.avail_out && !code)
+        {
+            if (!z.avail_in && flushed)
+            {
+                if (z.avail_out < RING_BLOCKSIZE && source_idle(source))
+                    break;
+                z.avail_in = source_read(ring, source, &next, &code);
+                z.next_in = (Bytef*)next;
+                if (!z.avail_in)
+                {
+                    end = TRUE;
+                    break;
+                }
+            }
+            status = inflate(&z, Z_NO_FLUSH);
+            flushed = z.avail_out > 0;
+            if (status == Z_OK)
+                member = TRUE;
+            else if (status == Z_STREAM_END)
+            {
+                member = FALSE;
+                inflateReset(&z);
+            }
+            else if (status == Z_MEM_ERROR)
+                code = ENOMEM;
+            else if (status != Z_BUF_ERROR)
+                code = EBADMSG;
+        }
+        if (z.avail_out < RING_BLOCKSIZE)
+            ring_commit(ring, RING_BLOCKSIZE - z.avail_out);
+    }
+
+    inflateEnd(&z);
+    /* Input that ends within a member is truncated */
+    if (!code && end && member)
+        code = EBADMSG;
+    return code;
+}
+#endif
+
+#ifdef TABLE_XZ
+/* xz data; concatenated streams are read one after another */
+static int
+decompress_xz(Ring* ring, Source* source)
+{
+    lzma_stream x = LZMA_STREAM_INIT;
+    lzma_action action = LZMA_RUN;
+    const uint8_t* next = NULL;
+    uint8_t* block = NULL;
+    BOOL flushed = TRUE;
+    BOOL end = FALSE;
+    lzma_ret status;
+    int code = 0;
+
+    if (lzma_stream_decoder(&x, UINT64_MAX, LZMA_CONCATENATED) != LZMA_OK)
+        return ENOMEM;
+
+    while (!code && !end && (block = ring_acquire(ring)))
+    {
+        x.next_out = block;
+        x.avail_out = RING_BLOCKSIZE;
+        while (x.avail_out && !code && !end)
+        {
+            if (!x.avail_in && flushed && action == LZMA_RUN)
+            {
+                if (x.avail_out < RING_BLOCKSIZE && source_idle(source))
+                    break;
+                x.avail_in = source_read(ring, source, &next, &code);
+                x.next_in = next;
+                if (code)
+                    break;
+                if (!x.avail_in)
+                    action = LZMA_FINISH;
+            }
+            status = lzma_code(&x, action);
+            flushed = x.avail_out > 0;
+            if (status == LZMA_STREAM_END)
+                end = TRUE;
+            else if (status == LZMA_MEM_ERROR)
+                code = ENOMEM;
+            else if (status != LZMA_OK)
+                code = EBADMSG;
+        }
+        if (x.avail_out < RING_BLOCKSIZE)
+            ring_commit(ring, RING_BLOCKSIZE - x.avail_out);
+    }
+
+    lzma_end(&x);
+    return code;
+}
+#endif
+
+#ifdef TABLE_ZSTD
+/* zstd data; concatenated frames are read one after another */
+static int
+decompress_zstd(Ring* ring, Source* source)
+{
+    ZSTD_DStream* z = ZSTD_createDStream();
+    ZSTD_inBuffer in = { NULL, 0, 0 };
+    ZSTD_outBuffer out = { NULL, 0, 0 };
+    const uint8_t* next = NULL;
+    uint8_t* block = NULL;
+    BOOL flushed = TRUE;
+    BOOL end = FALSE;
+    size_t status = 0;
+    int code = 0;
+
+    if (!z)
+        return ENOMEM;
+    ZSTD_initDStream(z);
+
+    while (!code && !end && (block = ring_acquire(ring)))
+    {
+        out.dst = block;
+        out.size = RING_BLOCKSIZE;
+        out.pos = 0;
+        while (out.pos < out.size && !code)
+        {
+            if (in.pos == in.size && flushed)
+            {
+                if (out.pos && source_idle(source))
+                    break;
+                in.size = source_read(ring, source, &next, &code);
+                in.src = next;
+                in.pos = 0;
+                if (!in.size)
+                {
+                    end = TRUE;
+                    break;
+                }
+            }
+            status = ZSTD_decompressStream(z, &out, &in);
+            flushed = out.pos < out.size;
+            if (ZSTD_isError(status))
+                code = EBADMSG;
+        }
+        if (out.pos)
+            ring_commit(ring, out.pos);
+    }
+
+    ZSTD_freeDStream(z);
+    /* Input that ends within a frame is truncated */
+    if (!code && end && status)
+        code = EBADMSG;
+    return code;
+}
+#endif
+
+/* RingFunc decompressing a Source */
+static int
+decompress(Ring* ring, void* context)
+{
+    Source* source = context;
+    int code = EINVAL;
+
+    switch (source->codec)
+    {
+    case CODEC_NONE:
+        code = decompress_none(ring, source);
+        break;
+#ifdef TABLE_GZIP
+    case CODEC_GZIP:
+        code = decompress_gzip(ring, source);
+        break;
+#endif
+#ifdef TABLE_XZ
+    case CODEC_XZ:
+        code = decompress_xz(ring, source);
+        break;
+#endif
+#ifdef TABLE_ZSTD
+    case CODEC_ZSTD:
+        code = decompress_zstd(ring, source);
+        break;
+#endif
+    }
+
+    if (source->mapping)
+        munmap(source->mapping, source->size);
+    free(source->buffer);
+    free(source);
+    return code;
+}
+
+/*
+ * Start decompressing codec data on a thread of its own, into a ring the
+ * caller reads with ring_take(). Data is either a mapped file, which the
+ * producer then owns and unmaps, or the first bytes of the stream fd, which
+ * are copied and followed by the rest of the stream. The data ends with
+ * EBADMSG if it is corrupt or truncated. With CODEC_NONE, a stream is only
+ * read ahead. Returns NULL if this build cannot decompress codec, or no
+ * thread can be started.
+ */
+Ring*
+decompress_start(int codec, int fd, uint8_t* data, size_t length,
+        BOOL mapped)
+{
+    Source* source = NULL;
+    Ring* ring = NULL;
+
+    if (!codec_supported(codec) || (codec == CODEC_NONE && mapped))
+        return NULL;
+
+    CALLOC(source, Source, 1)
+    source->codec = codec;
+    source->length = length;
+    if (mapped)
+    {
+        source->fd = -1;
+        source->data = source->mapping = data;
+        source->size = length;
+    }
+    else
+    {
+        source->fd = fd;
+        CALLOC(source->buffer, uint8_t,
+                length > DECOMPRESS_READSIZE ? length : DECOMPRESS_READSIZE)
+        memcpy(source->buffer, data, length);
+        source->data = source->buffer;
+    }
+
+    ring = ring_start(decompress, source);
+    if (!ring)
+    {
+        free(source->buffer);
+        free(source);
+    }
+    return ring;
+}
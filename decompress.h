@@ -0,0 +1,45 @@
+/*
+ *    table - Command line utility to format and display CSV.
+ *    Copyright (C) 2020  Страхиња Радић
+ *
+ *    This program is free software: you can redistribute it and/or modify it
+ *    under the terms of the GNU General Public License as published by the Free
+ *    Software Foundation, either version 3 of the License, or (at your option)
+ *    any later version.
+ *
+ *    This program is distributed in the hope that it will be useful, but
+ *    WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *    or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *    for more details.
+ *
+ *    You should have received a copy of the GNU General Public License along
+ *    with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __DECOMPRESS_H
+#define __DECOMPRESS_H
+
+#include "defs.h"
+#include "ring.h"
+
+/* Compression formats, told apart by the bytes they start with */
+enum
+{
+    CODEC_NONE,
+    CODEC_GZIP,
+    CODEC_XZ,
+    CODEC_ZSTD
+};
+
+/* Compressed bytes read from a stream at a time */
+#define DECOMPRESS_READSIZE (256 * 1024)
+
+int codec_detect(const uint8_t* data, size_t length);
+const char* codec_name(int codec);
+BOOL codec_supported(int codec);
+Ring* decompress_start(int codec, int fd, uint8_t* data, size_t length,
+        BOOL mapped);
+
+#endif
+
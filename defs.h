@@ -23,10 +23,21 @@
 #define _POSIX_C_SOURCE 200809L
 
 #include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <math.h>
+#include <poll.h>
+#include <signal.h>
 #include <stdarg.h>
+#include <stddef.h>
 #include <stdio.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
 #include <unistr.h>
 #include <unistdio.h>
 #include <uniwidth.h>
@@ -41,6 +52,93 @@
 #define ANSI_SGR_BOLD_ON  "\e[1m"
 #define ANSI_SGR_BOLD_OFF "\e[0m"
 
+/*
+ * Counters for --stats. They exist only in builds with TABLE_STATS (see
+ * table-stats.do); otherwise the macros below expand to nothing. Counters
+ * are shared by all threads and tables of the process.
+ */
+#ifdef TABLE_STATS
+
+enum
+{
+    STATS_OTHER,
+    STATS_READ,
+    STATS_PARSE,
+    STATS_SORT,
+    STATS_RENDER,
+    STATS_PHASES
+};
+
+typedef struct
+{
+    size_t   bytes_read;
+    size_t   bytes_written;
+    size_t   records;
+    size_t   fields;
+    size_t   truncated;      /* cells cut off at the column edge */
+    size_t   longest_line;
+    size_t   allocations;
+    size_t   reallocations;
+    uint64_t phase_ns[STATS_PHASES];
+} Stats;
+
+extern Stats stats;
+
+int stats_phase(int phase);
+void stats_max(size_t* counter, size_t value);
+void stats_print(FILE* file, int json, double seconds);
+
+#define STATS_ADD(counter, n) { \
+    __atomic_fetch_add(&stats.counter, (n), __ATOMIC_RELAXED); }
+#define STATS_MAX(counter, n) { stats_max(&stats.counter, (n)); }
+/* Time spent from here on goes to phase, until STATS_RESUME(saved) */
+#define STATS_PHASE(saved, phase) int saved = stats_phase(phase);
+#define STATS_RESUME(saved) { stats_phase(saved); }
+
+#else
+
+#define STATS_ADD(counter, n) { }
+#define STATS_MAX(counter, n) { }
+#define STATS_PHASE(saved, phase)
+#define STATS_RESUME(saved) { }
+
+#endif
+
+#define CHECKEXITNOMEM(ptr) { if (!ptr) exit(table_report(ENOMEM, \
+                (uint8_t*)"Memory allocation failed (out of memory?)")); }
+
+#define CALLOC(ptr, ptrtype, nmemb) { ptr = calloc(nmemb, sizeof(ptrtype)); \
+    CHECKEXITNOMEM(ptr) \
+    STATS_ADD(allocations, 1) }
+
+#define REALLOC(ptr, ptrtype, newsize) { ptrtype* newptr = realloc(ptr, newsize); \
+    CHECKEXITNOMEM(newptr) \
+    STATS_ADD(reallocations, 1) \
+    ptr = newptr; }
+
+#define REALLOCARRAY(ptr, membtype, newcount) \
+    REALLOC(ptr, membtype, sizeof(membtype) * newcount)
+
+#define CHECKCOPY(token, ptoken, token_size, parg) { \
+    if (ptoken + 2 > token + token_size) \
+    { \
+        size_t old_size = token_size; \
+        token_size += BUFSIZE; \
+        REALLOC(token, char, token_size) \
+        ptoken = token + old_size - 1; \
+    } \
+    *ptoken++ = *parg++; }
+
+#define CHECKSET(format, pformat, format_size, num) { \
+    if (pformat + 2 > format + format_size) \
+    { \
+        size_t old_size = format_size; \
+        format_size += BUFSIZE; \
+        REALLOC(format, ULONG, format_size) \
+        pformat = format + old_size - 1; \
+    } \
+    *pformat++ = num; }
+
 typedef enum
 {
     FALSE = 0,
@@ -57,10 +155,13 @@ typedef enum
     CMD_COLUMNS,
     CMD_DELIMITER,
     CMD_FORMAT,
+    CMD_JOBS,
     CMD_SYMBOLS,
     CMD_VERSION
 } Command;
 
+int table_report(int code, uint8_t* fmt, ...);
+
 enum
 {
     TABLE_SYMBOLS_ASCII,
@@ -77,7 +178,15 @@ enum
     TABLE_INNER_DOUBLE_DOUBLE
 };
 
-static const uint8_t* table_symbols[][9] =
+/* What becomes of bytes that are not UTF-8 */
+enum
+{
+    TABLE_INVALID_PASS,    /* written out as they are */
+    TABLE_INVALID_REPLACE, /* shown as U+FFFD */
+    TABLE_INVALID_ERROR    /* rendering stops at the first record with any */
+};
+
+static const uint8_t* const table_symbols[][9] =
 {
     [TABLE_SYMBOLS_ASCII] = {
         // ascii
@@ -99,7 +208,7 @@ static const uint8_t* table_symbols[][9] =
     }
 };
 
-static const uint8_t* table_inner_symbols[][3] =
+static const uint8_t* const table_inner_symbols[][3] =
 {
     [TABLE_INNER_ASCII_ASCII] = {
         // ascii -> ascii
@@ -137,5 +246,38 @@ static const uint8_t* table_inner_symbols[][3] =
     }
 };
 
+/* Lines between rows: left, horizontal, crossing, right */
+static const uint8_t* const table_separator_symbols[][4] =
+{
+    [TABLE_INNER_ASCII_ASCII] = {
+        // ascii -> ascii
+        (uint8_t*)"+", (uint8_t*)"-", (uint8_t*)"+", (uint8_t*)"+",
+    },
+
+    [TABLE_INNER_SINGLE_SINGLE] = {
+        // single -> single
+        (uint8_t*)"\u251c", (uint8_t*)"\u2500", (uint8_t*)"\u253c",
+        (uint8_t*)"\u2524",
+    },
+
+    [TABLE_INNER_SINGLE_DOUBLE] = {
+        // single -> double
+        (uint8_t*)"\u255e", (uint8_t*)"\u2550", (uint8_t*)"\u256c",
+        (uint8_t*)"\u2561",
+    },
+
+    [TABLE_INNER_DOUBLE_SINGLE] = {
+        // double -> single
+        (uint8_t*)"\u255f", (uint8_t*)"\u2500", (uint8_t*)"\u253c",
+        (uint8_t*)"\u2562",
+    },
+
+    [TABLE_INNER_DOUBLE_DOUBLE] = {
+        // double -> double
+        (uint8_t*)"\u2560", (uint8_t*)"\u2550", (uint8_t*)"\u256c",
+        (uint8_t*)"\u2563",
+    }
+};
+
 #endif
 
@@ -0,0 +1,175 @@
+/*
+ *    table - Command line utility to format and display CSV.
+ *    Copyright (C) 2020  Страхиња Радић
+ *
+ *    This program is free software: you can redistribute it and/or modify it
+ *    under the terms of the GNU General Public License as published by the Free
+ *    Software Foundation, either version 3 of the License, or (at your option)
+ *    any later version.
+ *
+ *    This program is distributed in the hope that it will be useful, but
+ *    WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *    or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *    for more details.
+ *
+ *    You should have received a copy of the GNU General Public License along
+ *    with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "index.h"
+
+/* Name of the index of filename: .<name>.tblidx in the same directory */
+static char*
+row_index_path(const char* filename)
+{
+    const char* name = strrchr(filename, '/');
+    size_t dir_len = name ? (size_t)(name - filename) + 1 : 0;
+    char* path = NULL;
+
+    name = name ? name+1 : filename;
+    CALLOC(path, char, dir_len + 1 + strlen(name) + strlen(ROW_INDEX_SUFFIX) + 1)
+    memcpy(path, filename, dir_len);
+    sprintf(path + dir_len, ".%s%s", name, ROW_INDEX_SUFFIX);
+
+    return path;
+}
+
+/* Read the index at path; FALSE if it is missing or out of date */
+static BOOL
+row_index_load(RowIndex* index, const char* path)
+{
+    RowIndex stored;
+    char magic[sizeof(ROW_INDEX_MAGIC)];
+    FILE* file = fopen(path, "rb");
+    BOOL valid = FALSE;
+
+    if (!file)
+        return FALSE;
+
+    if (fread(magic, sizeof(magic), 1, file) == 1
+            && !memcmp(magic, ROW_INDEX_MAGIC, sizeof(magic))
+            && fread(&stored, offsetof(RowIndex, offsets), 1, file) == 1
+            && stored.size == index->size
+            && stored.mtime_sec == index->mtime_sec
+            && stored.mtime_nsec == index->mtime_nsec
+            && stored.stride == index->stride
+            && stored.flags == index->flags)
+    {
+        index->rows = stored.rows;
+        index->count = stored.rows ? (stored.rows - 1) / stored.stride + 1 : 0;
+        CALLOC(index->offsets, uint64_t, index->count + 1)
+        valid = fread(index->offsets, sizeof(uint64_t), index->count, file)
+            == index->count;
+        if (!valid)
+        {
+            free(index->offsets);
+            index->offsets = NULL;
+            index->count = 0;
+        }
+    }
+    fclose(file);
+
+    return valid;
+}
+
+/* Write the index to path through a temporary file; failures are ignored,
+ * the index is then just rebuilt next time */
+static void
+row_index_save(const RowIndex* index, const char* path)
+{
+    char* temp = NULL;
+    FILE* file;
+    int fd;
+    BOOL ok;
+
+    CALLOC(temp, char, strlen(path) + 8)
+    sprintf(temp, "%s.XXXXXX", path);
+    fd = mkstemp(temp);
+    if (fd < 0 || !(file = fdopen(fd, "wb")))
+    {
+        if (fd >= 0)
+        {
+            close(fd);
+            unlink(temp);
+        }
+        free(temp);
+        return;
+    }
+
+    fchmod(fd, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+    ok = fwrite(ROW_INDEX_MAGIC, sizeof(ROW_INDEX_MAGIC), 1, file) == 1
+        && fwrite(index, offsetof(RowIndex, offsets), 1, file) == 1
+        && fwrite(index->offsets, sizeof(uint64_t), index->count, file)
+            == index->count;
+    if (fclose(file) || !ok || rename(temp, path))
+        unlink(temp);
+    free(temp);
+}
+
+/* Scan the whole input for row offsets, skipping the header */
+static void
+row_index_build(RowIndex* index, Input* in, RecordFunc next_record)
+{
+    const uint8_t* record = NULL;
+    size_t record_len = 0;
+    size_t size = SMALL_BUFSIZE;
+
+    CALLOC(index->offsets, uint64_t, size)
+    if (!next_record(in, &record, &record_len))
+        return;
+
+    while (next_record(in, &record, &record_len))
+    {
+        if (index->rows % index->stride == 0)
+        {
+            if (index->count == size)
+            {
+                size *= 2;
+                REALLOCARRAY(index->offsets, uint64_t, size)
+            }
+            index->offsets[index->count++] = record - in->data;
+        }
+        index->rows++;
+    }
+}
+
+/*
+ * Load the row index of filename, or build it from in (a mapped file) and
+ * save it for next time. The input is rewound to its start afterwards.
+ */
+void
+row_index_open(RowIndex* index, const char* filename, Input* in,
+        size_t stride, UINT flags, RecordFunc next_record)
+{
+    struct stat st;
+    char* path = row_index_path(filename);
+
+    memset(index, 0, sizeof(RowIndex));
+    index->stride = stride ? stride : ROW_INDEX_STRIDE;
+    index->flags = flags;
+    if (!fstat(in->fd, &st))
+    {
+        index->size = st.st_size;
+        index->mtime_sec = st.st_mtim.tv_sec;
+        index->mtime_nsec = st.st_mtim.tv_nsec;
+    }
+
+    if (!row_index_load(index, path))
+    {
+        row_index_build(index, in, next_record);
+        in->position = 0;
+        row_index_save(index, path);
+    }
+
+    free(path);
+}
+
+void
+row_index_free(RowIndex* index)
+{
+    free(index->offsets);
+    index->offsets = NULL;
+    index->count = 0;
+}
+
@@ -0,0 +1,60 @@
+/*
+ *    table - Command line utility to format and display CSV.
+ *    Copyright (C) 2020  Страхиња Радић
+ *
+ *    This program is free software: you can redistribute it and/or modify it
+ *    under the terms of the GNU General Public License as published by the Free
+ *    Software Foundation, either version 3 of the License, or (at your option)
+ *    any later version.
+ *
+ *    This program is distributed in the hope that it will be useful, but
+ *    WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *    or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *    for more details.
+ *
+ *    You should have received a copy of the GNU General Public License along
+ *    with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __INDEX_H
+#define __INDEX_H
+
+#include "defs.h"
+#include "input.h"
+
+#define ROW_INDEX_MAGIC  "TBLIDX3"
+#define ROW_INDEX_SUFFIX ".tblidx"
+
+/* Default number of rows between two indexed offsets */
+#define ROW_INDEX_STRIDE 1024
+
+/* Reads the next record of in, as the renderer would */
+typedef BOOL (*RecordFunc)(Input* in, const uint8_t** record,
+        size_t* record_len);
+
+/*
+ * Offsets of every stride-th row of a file, header excluded: offsets[k] is
+ * where row k*stride+1 starts. Kept next to the file as .<name>.tblidx and
+ * valid as long as the size and modification time of the file match, and
+ * the flags it was built with: whatever rows depend on, such as the field
+ * delimiter, after which quoting may start.
+ */
+typedef struct
+{
+    uint64_t  size;
+    int64_t   mtime_sec;
+    int64_t   mtime_nsec;
+    uint64_t  stride;
+    uint64_t  flags;
+    uint64_t  rows;
+    uint64_t* offsets;
+    size_t    count;
+} RowIndex;
+
+void row_index_open(RowIndex* index, const char* filename, Input* in,
+        size_t stride, UINT flags, RecordFunc next_record);
+void row_index_free(RowIndex* index);
+
+#endif
+
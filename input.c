@@ -0,0 +1,829 @@
+/*
+ *    table - Command line utility to format and display CSV.
+ *    Copyright (C) 2020  Страхиња Радић
+ *
+ *    This program is free software: you can redistribute it and/or modify it
+ *    under the terms of the GNU General Public License as published by the Free
+ *    Software Foundation, either version 3 of the License, or (at your option)
+ *    any later version.
+ *
+ *    This program is distributed in the hope that it will be useful, but
+ *    WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *    or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *    for more details.
+ *
+ *    You should have received a copy of the GNU General Public License along
+ *    with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "decompress.h"
+#include "input.h"
+#include "scan.h"
+#include "width.h"
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
+/* How far input_cut() has looked into the line being read */
+typedef struct
+{
+    size_t scanned;  /* bytes from the start of the line */
+    UINT   quoting;  /* at scanned, see scan_quoting() */
+    size_t field;    /* start of the field being read, or of the line */
+    UINT   opening;  /* quoting at field */
+} LineCut;
+
+/* Set by SIGINT and SIGTERM while following, to end the input cleanly */
+static volatile sig_atomic_t interrupted = 0;
+
+static void
+interrupt(int signum)
+{
+    interrupted = signum;
+}
+
+/*
+ * Set up following of in->path: catch SIGINT and SIGTERM so that a wait
+ * can be cut short, and ask inotify to report changes to the file and its
+ * directory. Without inotify, the file is simply polled.
+ */
+static void
+input_follow(Input* in)
+{
+    struct sigaction action;
+
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = interrupt;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    in->watch_fd = -1;
+#ifdef __linux__
+    in->watch_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (in->watch_fd >= 0)
+    {
+        char* dir = strdup(in->path);
+        char* slash = dir ? strrchr(dir, '/') : NULL;
+
+        in->watch = inotify_add_watch(in->watch_fd, in->path,
+                IN_MODIFY | IN_ATTRIB | IN_MOVE_SELF | IN_DELETE_SELF);
+        if (slash)
+            *(slash == dir ? slash+1 : slash) = 0;
+        inotify_add_watch(in->watch_fd, slash ? dir : ".",
+                IN_CREATE | IN_MOVED_TO);
+        free(dir);
+    }
+#endif
+}
+
+/* Sleep until inotify reports a change or FOLLOW_INTERVAL passes */
+static void
+input_sleep(Input* in)
+{
+    struct pollfd pfd;
+
+    pfd.fd = in->watch_fd;
+    pfd.events = POLLIN;
+    if (poll(&pfd, in->watch_fd >= 0 ? 1 : 0, FOLLOW_INTERVAL) > 0)
+    {
+        uint8_t events[BUFSIZE];
+        while (read(in->watch_fd, events, sizeof(events)) > 0)
+            ;
+    }
+}
+
+/* Forget buffered data after the followed file started over */
+static void
+input_restart(Input* in)
+{
+    in->offset = 0;
+    in->length = in->position;
+    in->generation++;
+}
+
+/*
+ * Wait for the followed file to have something more to read: new data, a
+ * truncation (read again from its start) or a new file under the same name
+ * (rotation; read the new one). Returns FALSE if interrupted by a signal.
+ */
+static BOOL
+input_wait(Input* in)
+{
+    struct stat st, st_path;
+    int fd;
+
+    while (!interrupted)
+    {
+        if (fstat(in->fd, &st))
+            return FALSE;
+        if (st.st_size > in->offset)
+            return TRUE;
+        if (st.st_size < in->offset)
+        {
+            lseek(in->fd, 0, SEEK_SET);
+            input_restart(in);
+            return TRUE;
+        }
+        if (!stat(in->path, &st_path)
+                && (st_path.st_ino != st.st_ino || st_path.st_dev != st.st_dev)
+                && (fd = open(in->path, O_RDONLY)) >= 0)
+        {
+            close(in->fd);
+            in->fd = fd;
+#ifdef __linux__
+            if (in->watch_fd >= 0)
+            {
+                inotify_rm_watch(in->watch_fd, in->watch);
+                in->watch = inotify_add_watch(in->watch_fd, in->path,
+                        IN_MODIFY | IN_ATTRIB | IN_MOVE_SELF | IN_DELETE_SELF);
+            }
+#endif
+            input_restart(in);
+            return TRUE;
+        }
+        input_sleep(in);
+    }
+
+    return FALSE;
+}
+
+/* Try to map a regular file; returns FALSE if it has to be streamed */
+static BOOL
+input_map(Input* in)
+{
+    struct stat st;
+    void* data;
+
+    if (fstat(in->fd, &st) || !S_ISREG(st.st_mode) || st.st_size <= 0)
+        return FALSE;
+
+    data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, in->fd, 0);
+    if (data == MAP_FAILED)
+        return FALSE;
+    posix_madvise(data, st.st_size, POSIX_MADV_SEQUENTIAL);
+
+    in->data = data;
+    in->size = in->length = st.st_size;
+    in->mapped = TRUE;
+    in->eof = TRUE;
+    return TRUE;
+}
+
+/*
+ * Read the input from a decompressor from now on, or, for an uncompressed
+ * stream, from a thread reading it ahead. The bytes in data, a mapping or
+ * the first bytes of the stream, are handed over to it, and a buffer is
+ * kept for records that do not fit in front of a block. An uncompressed
+ * stream is read here after all if no thread can be started.
+ */
+static int
+input_decompress(Input* in, int codec)
+{
+    const char* name = codec_name(codec);
+
+    if (!codec_supported(codec))
+        return table_report(ENOTSUP, (uint8_t*)"Cannot read %s input: table was"
+                " built without %s support", name, name);
+    in->ring = decompress_start(codec, in->fd, in->data, in->length,
+            in->mapped);
+    if (!in->ring && codec == CODEC_NONE)
+        return 0;
+    if (!in->ring)
+        return table_report(EAGAIN, (uint8_t*)"Cannot decompress %s input: %s",
+                name, strerror(EAGAIN));
+
+    if (in->mapped)
+    {
+        in->mapped = FALSE;
+        in->eof = FALSE;
+        in->size = INPUT_BLOCKSIZE;
+        CALLOC(in->data, uint8_t, in->size)
+    }
+    in->buffer = in->data;
+    in->codec = codec;
+    in->offset = 0;
+    in->length = in->position = in->mark = 0;
+    return 0;
+}
+
+/*
+ * Open filename, or standard input if filename is NULL. With follow, a file
+ * is read as it grows (see input_wait()). Compressed input is decompressed
+ * as it is read; that of a stream is detected when it is first read.
+ */
+int
+input_open(Input* in, const char* filename, BOOL follow)
+{
+    int codec;
+
+    memset(in, 0, sizeof(Input));
+    in->watch_fd = -1;
+    in->delimiter = ',';
+
+    if (filename)
+    {
+        in->fd = open(filename, O_RDONLY);
+        if (in->fd < 0)
+            return table_report(ENOENT, (uint8_t*)"File not found: %s",
+                    filename);
+    }
+    else
+        in->fd = STDIN_FILENO;
+
+    if (follow && filename)
+    {
+        in->follow = TRUE;
+        in->path = filename;
+        input_follow(in);
+    }
+
+    if (in->follow || !input_map(in))
+    {
+        in->size = INPUT_BLOCKSIZE;
+        CALLOC(in->data, uint8_t, in->size)
+    }
+    else if ((codec = codec_detect(in->data, in->length)) > CODEC_NONE)
+        return input_decompress(in, codec);
+
+    return 0;
+}
+
+/* Read lines from data, which stays owned by the caller */
+void
+input_from_memory(Input* in, const uint8_t* data, size_t length)
+{
+    memset(in, 0, sizeof(Input));
+    in->fd = -1;
+    in->watch_fd = -1;
+    in->delimiter = ',';
+    in->data = (uint8_t*)data;
+    in->size = in->length = length;
+    in->eof = TRUE;
+}
+
+/* Read lines from data given to input_push(), up to input_end() */
+void
+input_init_push(Input* in)
+{
+    memset(in, 0, sizeof(Input));
+    in->fd = -1;
+    in->watch_fd = -1;
+    in->delimiter = ',';
+    in->pushed = TRUE;
+    in->size = INPUT_BLOCKSIZE;
+    CALLOC(in->data, uint8_t, in->size)
+}
+
+/*
+ * Discard consumed bytes from the stream buffer, except those after a
+ * mark, and make room for at least length more
+ */
+static void
+input_compact(Input* in, size_t length)
+{
+    size_t discard = in->marked ? in->mark : in->position;
+
+    if (discard)
+    {
+        memmove(in->data, in->data + discard, in->length - discard);
+        in->length -= discard;
+        in->position -= discard;
+        if (in->marked)
+            in->mark = 0;
+    }
+    if (in->length + length > in->size)
+    {
+        while (in->length + length > in->size)
+            in->size *= 2;
+        REALLOC(in->data, uint8_t, in->size)
+    }
+}
+
+/* Append data to a push input. Lines are returned once they are complete. */
+void
+input_push(Input* in, const uint8_t* data, size_t length)
+{
+    input_compact(in, length);
+    memcpy(in->data + in->length, data, length);
+    STATS_ADD(bytes_read, length)
+    in->length += length;
+    in->offset += length;
+}
+
+/* No more data will be pushed; the last line need not end in a newline */
+void
+input_end(Input* in)
+{
+    in->eof = TRUE;
+}
+
+void
+input_close(Input* in)
+{
+    /* Blocks of the ring go with it */
+    if (in->ring)
+    {
+        ring_stop(in->ring);
+        in->data = in->buffer;
+    }
+    if (in->mapped)
+    {
+        /* Mapped data counts as read as far as it was parsed */
+        STATS_ADD(bytes_read, in->position)
+        munmap(in->data, in->size);
+    }
+    else
+        free(in->data);
+    if (in->fd >= 0 && in->fd != STDIN_FILENO)
+        close(in->fd);
+    if (in->watch_fd >= 0)
+        close(in->watch_fd);
+    in->data = NULL;
+}
+
+/* Milliseconds left until the deadline, or 0 once it has passed */
+static int
+input_remaining(const Input* in)
+{
+    struct timespec now;
+    long long ms;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    ms = (in->deadline.tv_sec - now.tv_sec) * 1000LL
+        + (in->deadline.tv_nsec - now.tv_nsec) / 1000000;
+    return ms <= 0 ? 0 : ms > INT_MAX ? INT_MAX : (int)ms;
+}
+
+/* Wait for data on a stream until the deadline; FALSE if it passed */
+static BOOL
+input_ready(Input* in)
+{
+    struct pollfd pfd;
+    int ready;
+
+    pfd.fd = in->fd;
+    pfd.events = POLLIN;
+    do
+        ready = poll(&pfd, 1, input_remaining(in));
+    while (ready < 0 && errno == EINTR && !interrupted);
+
+    if (ready == 0)
+        in->expired = TRUE;
+    return ready != 0;
+}
+
+/*
+ * Take the next block of decompressed data. The unread end of the data,
+ * from the mark if there is one, is carried over in front of the block if
+ * it fits, and the block is read in place; otherwise both are copied to
+ * the buffer, which grows as needed. Returns FALSE at the end of the data,
+ * or once the deadline has passed.
+ */
+static BOOL
+input_take(Input* in)
+{
+    size_t keep_from = in->marked ? in->mark : in->position;
+    size_t keep = in->length - keep_from;
+    BOOL held = in->data != in->buffer;
+    uint8_t* data = NULL;
+    size_t length = 0;
+    BOOL taken;
+    int code;
+
+    STATS_PHASE(phase, STATS_READ)
+    taken = ring_take(in->ring, &data, &length,
+            in->timed ? &in->deadline : NULL);
+    STATS_RESUME(phase)
+    if (!taken)
+    {
+        if (in->timed && !input_remaining(in))
+        {
+            in->expired = TRUE;
+            return FALSE;
+        }
+        if ((code = ring_error(in->ring)) && in->codec == CODEC_NONE)
+            table_report(code, (uint8_t*)"Read error: %s", strerror(code));
+        else if (code)
+            table_report(code, (uint8_t*)"Cannot decompress %s input: %s",
+                    codec_name(in->codec), code == EBADMSG
+                    ? "corrupt or truncated data" : strerror(code));
+        in->eof = TRUE;
+        return FALSE;
+    }
+    STATS_ADD(bytes_read, length)
+    in->offset += length;
+
+    if (keep <= RING_HEADROOM)
+    {
+        memcpy(data - keep, in->data + keep_from, keep);
+        in->data = data - keep;
+    }
+    else
+    {
+        /* Data already in the buffer moves before it grows */
+        if (!held && keep_from)
+            memmove(in->buffer, in->data + keep_from, keep);
+        if (keep + length > in->size)
+        {
+            while (keep + length > in->size)
+                in->size *= 2;
+            REALLOC(in->buffer, uint8_t, in->size)
+        }
+        if (held)
+            memcpy(in->buffer, in->data + keep_from, keep);
+        memcpy(in->buffer + keep, data, length);
+        in->data = in->buffer;
+    }
+    /* Blocks go back in the order they were taken */
+    if (held)
+        ring_release(in->ring);
+    if (in->data == in->buffer)
+        ring_release(in->ring);
+
+    in->length = keep + length;
+    in->position -= keep_from;
+    if (in->marked)
+        in->mark -= keep_from;
+    return TRUE;
+}
+
+/*
+ * Check the first bytes of a stream for a compression format. The stream
+ * is read from then on through input_take(), while another thread reads,
+ * and decompresses if need be, the blocks after the one being parsed.
+ */
+static BOOL
+input_detect(Input* in)
+{
+    int codec = codec_detect(in->data, in->length);
+
+    in->detected = TRUE;
+    if (codec < CODEC_NONE)
+        return TRUE;
+    if (input_decompress(in, codec))
+    {
+        in->eof = TRUE;
+        return FALSE;
+    }
+    return in->ring ? input_take(in) : TRUE;
+}
+
+/*
+ * Make room for more data in the stream buffer and read into it. Consumed
+ * bytes are discarded first, except those after a mark; the buffer only
+ * grows when a single line (or the marked data) does not fit. Returns FALSE
+ * once there is nothing more to read.
+ */
+static BOOL
+input_fill(Input* in)
+{
+    ssize_t bytes_read;
+
+    if (in->pushed)
+        return FALSE;
+    if (in->ring)
+        return input_take(in);
+    input_compact(in, 1);
+
+    STATS_PHASE(phase, STATS_READ)
+    for (;;)
+    {
+        if (in->timed && !input_ready(in))
+        {
+            STATS_RESUME(phase)
+            return FALSE;
+        }
+        bytes_read = read(in->fd, in->data + in->length,
+                in->size - in->length);
+        if (bytes_read > 0)
+        {
+            STATS_ADD(bytes_read, bytes_read)
+            in->length += bytes_read;
+            in->offset += bytes_read;
+            /* Too few bytes yet to tell whether the stream is compressed */
+            if (!in->detected && !in->follow
+                    && codec_detect(in->data, in->length) < 0)
+                continue;
+            break;
+        }
+        if (bytes_read < 0 && errno == EINTR && !interrupted)
+            continue;
+        if (bytes_read == 0 && in->follow && input_wait(in))
+            continue;
+
+        if (bytes_read < 0 && !interrupted)
+            table_report(errno, (uint8_t*)"Read error: %s", strerror(errno));
+        in->eof = TRUE;
+        STATS_RESUME(phase)
+        return FALSE;
+    }
+    STATS_RESUME(phase)
+    if (!in->detected && !in->follow)
+        return input_detect(in);
+    return TRUE;
+}
+
+/*
+ * Bytes at the start of field text that take more than columns columns,
+ * counted low: quotes, line breaks and bytes that are not UTF-8 take none.
+ * Reads on from *quoting, which is set to the quoting after them. Returns
+ * 0 unless something of text is left after them.
+ */
+static size_t
+cut_length(const uint8_t* text, size_t length, size_t columns,
+        UINT* quoting)
+{
+    UINT state = *quoting;
+    size_t width = 0;
+    size_t i = 0;
+
+    while (i < length)
+    {
+        ucs4_t uc = 0;
+        int bytes;
+
+        if (text[i] == '"')
+        {
+            if (state == SCAN_QUOTED)
+                state = SCAN_CLOSED;
+            else if (state != SCAN_UNQUOTED)
+                state = SCAN_QUOTED;
+            i++;
+            continue;
+        }
+        bytes = u8_mbtoucr(&uc, text + i, length - i);
+        if (bytes == -2)
+            return 0;
+        if (bytes < 0)
+            bytes = 1;
+        else if (uc != '\r' && uc != '\n')
+            width += char_width(uc);
+        if (state != SCAN_QUOTED)
+            state = SCAN_UNQUOTED;
+        i += bytes;
+        if (width > columns)
+        {
+            *quoting = state;
+            return i < length ? i : 0;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Cut the field the line being read has got to once it is wider than
+ * in->max_columns. What a table can show of it is kept, and a quoted field
+ * is closed after it; the rest is read on and left out, block by block, up
+ * to the delimiter or line break that ends the field, so that memory does
+ * not grow with the field. Returns whether the field was cut; cut then
+ * tells where the line goes on.
+ */
+static BOOL
+input_cut(Input* in, LineCut* cut)
+{
+    uint8_t delimiter = (uint8_t)in->delimiter;
+    uint8_t* line = in->data + in->position;
+    size_t available = in->length - in->position;
+    size_t generation = in->generation;
+    size_t keep;
+    size_t end;
+    UINT quoting;
+    UINT kept;
+
+    while (cut->scanned < available)
+    {
+        end = scan_field_end(line + cut->scanned, available - cut->scanned,
+                delimiter, &cut->quoting);
+        cut->scanned += end;
+        if (cut->scanned == available)
+            break;
+        cut->field = ++cut->scanned;
+        cut->quoting = cut->opening = SCAN_FIELD;
+    }
+
+    quoting = cut->opening;
+    keep = cut_length(line + cut->field, available - cut->field,
+            in->max_columns, &quoting);
+    if (!keep)
+        return FALSE;
+    keep += cut->field;
+    kept = quoting;
+    end = keep + scan_field_end(line + keep, available - keep, delimiter,
+            &quoting);
+    if (end == keep)
+        return FALSE;
+
+    /* The closing quote takes the place of the first byte left out */
+    cut->quoting = SCAN_UNQUOTED;
+    if (kept == SCAN_QUOTED)
+    {
+        line[keep++] = '"';
+        cut->quoting = SCAN_CLOSED;
+    }
+    cut->scanned = keep;
+    memmove(line + keep, line + end, available - end);
+    in->length -= end - keep;
+    in->skipped += end - keep;
+
+    /* Read on until the end of the field turns up */
+    while (end == available)
+    {
+        if (!input_fill(in) || in->generation != generation)
+            break;
+        line = in->data + in->position;
+        available = in->length - in->position;
+        end = keep + scan_field_end(line + keep, available - keep,
+                delimiter, &quoting);
+        memmove(line + keep, line + end, available - end);
+        in->length -= end - keep;
+        in->skipped += end - keep;
+    }
+    return TRUE;
+}
+
+/*
+ * Read the next line into *line and *line_len, which starts with the given
+ * quoting. With cut, fields that the table cannot show whole are cut, see
+ * input_cut().
+ */
+static BOOL
+input_read_line(Input* in, const uint8_t** line, size_t* line_len,
+        UINT quoting, BOOL cut)
+{
+    uint8_t* eol = NULL;
+    size_t scanned = 0;
+    LineCut line_cut;
+
+    line_cut.scanned = line_cut.field = 0;
+    line_cut.quoting = line_cut.opening = quoting;
+    for (;;)
+    {
+        uint8_t* start = in->data + in->position;
+        size_t available = in->length - in->position;
+        size_t generation = in->generation;
+
+        eol = memchr(start + scanned, '\n', available - scanned);
+        if (eol || in->eof)
+            break;
+        scanned = available;
+        if (cut && available >= INPUT_CUT_LENGTH
+                && input_cut(in, &line_cut))
+        {
+            scanned = line_cut.scanned;
+            if (in->expired)
+                return FALSE;
+        }
+        else if (!input_fill(in) && (in->expired || in->pushed))
+            return FALSE;
+        if (in->generation != generation)
+        {
+            /* A followed file that started over starts with a record */
+            scanned = 0;
+            line_cut.scanned = line_cut.field = 0;
+            line_cut.quoting = line_cut.opening = SCAN_FIELD;
+        }
+    }
+
+    *line = in->data + in->position;
+    if (eol)
+    {
+        *line_len = eol - *line;
+        in->position += *line_len + 1;
+    }
+    else
+    {
+        *line_len = in->length - in->position;
+        in->position = in->length;
+    }
+
+    return eol || *line_len;
+}
+
+/*
+ * Return the next line, without its line terminator, in *line and
+ * *line_len. The line stays valid until the next call. Returns FALSE at
+ * the end of the input.
+ */
+BOOL
+input_next_line(Input* in, const uint8_t** line, size_t* line_len)
+{
+    return input_read_line(in, line, line_len, SCAN_FIELD, FALSE);
+}
+
+/*
+ * Return the next record in *record and *record_len: the next line, joined
+ * with the lines following it for as long as a quoted field is left open.
+ * Line breaks within the record are kept; its terminator, LF or CRLF, is
+ * not. With in->max_columns set, a stream keeps of a field only what a
+ * table that wide can show, see input_cut(). The record stays valid until
+ * the next call. Returns FALSE at the end of the input.
+ */
+BOOL
+input_next_record(Input* in, const uint8_t** record, size_t* record_len)
+{
+    const uint8_t* line = NULL;
+    size_t line_len = 0;
+    size_t trailing = 0; /* bytes consumed after the last line */
+    size_t consumed = 0;
+    UINT quoting = SCAN_FIELD;
+    BOOL marked = in->marked;
+    BOOL cut = in->max_columns && !in->mapped && !in->pushed
+        && in->delimiter < 0x80;
+
+    /* Keep the first lines in the buffer while the next ones are read */
+    if (!marked)
+    {
+        in->mark = in->position;
+        in->marked = TRUE;
+    }
+    while (input_read_line(in, &line, &line_len,
+                quoting == SCAN_QUOTED ? SCAN_QUOTED : SCAN_FIELD, cut))
+    {
+        consumed += in->position - (line - in->data);
+        quoting = scan_quoting(line, line_len, in->delimiter, quoting);
+        /* Reading on may move the data, so the end is kept as an offset */
+        trailing = in->position - (line + line_len - in->data);
+        if (quoting != SCAN_QUOTED)
+            break;
+    }
+    in->marked = marked;
+
+    /* Wait for the rest of a record that has not been pushed yet */
+    if (in->pushed && !in->eof && quoting == SCAN_QUOTED)
+    {
+        in->position -= consumed;
+        return FALSE;
+    }
+    if (!consumed)
+        return FALSE;
+    *record = in->data + in->position - consumed;
+    *record_len = consumed - trailing;
+    if (*record_len && (*record)[*record_len-1] == '\r')
+        (*record_len)--;
+    return TRUE;
+}
+
+/*
+ * Remember the current position. Lines read after this stay in memory until
+ * input_rewind() returns to it, which lets the caller look ahead.
+ */
+void
+input_mark(Input* in)
+{
+    in->mark = in->position;
+    in->mark_skipped = in->skipped;
+    in->marked = TRUE;
+}
+
+/* Number of bytes read since input_mark(), those left out of fields too */
+size_t
+input_since_mark(const Input* in)
+{
+    return in->position - in->mark + in->skipped - in->mark_skipped;
+}
+
+/* Number of bytes taken from the source so far */
+size_t
+input_consumed(const Input* in)
+{
+    return in->mapped ? in->position
+        : (size_t)in->offset - (in->length - in->position);
+}
+
+/*
+ * Stop reading after ms milliseconds from now: input_next_line() returns
+ * FALSE once a stream has had nothing to read until then.
+ */
+void
+input_set_deadline(Input* in, size_t ms)
+{
+    clock_gettime(CLOCK_MONOTONIC, &in->deadline);
+    in->deadline.tv_sec += ms / 1000;
+    in->deadline.tv_nsec += (ms % 1000) * 1000000;
+    if (in->deadline.tv_nsec >= 1000000000)
+    {
+        in->deadline.tv_sec++;
+        in->deadline.tv_nsec -= 1000000000;
+    }
+    in->timed = TRUE;
+}
+
+/* Whether the deadline set by input_set_deadline() has passed */
+BOOL
+input_expired(Input* in)
+{
+    if (in->timed && !in->expired && !input_remaining(in))
+        in->expired = TRUE;
+    return in->expired;
+}
+
+void
+input_rewind(Input* in)
+{
+    in->position = in->mark;
+    in->marked = FALSE;
+}
+
@@ -0,0 +1,94 @@
+/*
+ *    table - Command line utility to format and display CSV.
+ *    Copyright (C) 2020  Страхиња Радић
+ *
+ *    This program is free software: you can redistribute it and/or modify it
+ *    under the terms of the GNU General Public License as published by the Free
+ *    Software Foundation, either version 3 of the License, or (at your option)
+ *    any later version.
+ *
+ *    This program is distributed in the hope that it will be useful, but
+ *    WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *    or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *    for more details.
+ *
+ *    You should have received a copy of the GNU General Public License along
+ *    with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __INPUT_H
+#define __INPUT_H
+
+#include "defs.h"
+#include "ring.h"
+
+/* Initial size of the buffer used for streams, grown for longer lines */
+#define INPUT_BLOCKSIZE (64 * 1024)
+
+/* How often a followed file is checked for rotation, in milliseconds */
+#define FOLLOW_INTERVAL 1000
+
+/* Length of a line from which on its fields are checked for being cut */
+#define INPUT_CUT_LENGTH INPUT_BLOCKSIZE
+
+/*
+ * Input source. Regular files are memory-mapped and records point straight
+ * into the mapping; anything else (stdin, pipes, /proc files) is read into
+ * a buffer that grows to hold the longest line. A followed file is always
+ * read that way, and instead of ending the input at its end the reader
+ * waits for it to grow, be truncated or be replaced. Other streams are read
+ * ahead, and compressed input is decompressed, on a thread of its own; data
+ * then points into the blocks of its ring, or into buffer for a record
+ * longer than the room left in front of a block. Fields of a stream that
+ * are too wide to be shown can be cut short as they are read.
+ */
+typedef struct
+{
+    int      fd;
+    const char* path;  /* name of the followed file */
+    off_t    offset;   /* bytes read from fd */
+    int      watch_fd; /* inotify instance, or -1 */
+    int      watch;    /* inotify watch on the followed file */
+    uint8_t* data;
+    size_t   size;     /* size of the mapping or capacity of the buffer */
+    size_t   length;   /* number of valid bytes in data */
+    size_t   position; /* start of the next line */
+    size_t   mark;     /* position to return to, see input_mark() */
+    BOOL     marked;
+    BOOL     mapped;
+    BOOL     eof;
+    BOOL     follow;
+    BOOL     pushed;   /* data comes from input_push(), not fd */
+    ucs4_t   delimiter; /* of fields, which tells where quoting may start */
+    size_t   max_columns; /* width past which fields of a stream are cut,
+                             or 0; see input_next_record() */
+    size_t   skipped;  /* bytes left out of cut fields */
+    size_t   mark_skipped; /* skipped at the mark */
+    size_t   generation; /* times the followed file started over */
+    Ring*    ring;     /* data read ahead, or NULL */
+    uint8_t* buffer;   /* own buffer of a decompressed input */
+    int      codec;
+    BOOL     detected; /* the stream was checked for compression */
+    struct timespec deadline; /* give up waiting for data after this */
+    BOOL     timed;
+    BOOL     expired;
+} Input;
+
+int input_open(Input* in, const char* filename, BOOL follow);
+void input_from_memory(Input* in, const uint8_t* data, size_t length);
+void input_init_push(Input* in);
+void input_push(Input* in, const uint8_t* data, size_t length);
+void input_end(Input* in);
+void input_close(Input* in);
+BOOL input_next_line(Input* in, const uint8_t** line, size_t* line_len);
+BOOL input_next_record(Input* in, const uint8_t** record, size_t* record_len);
+void input_mark(Input* in);
+size_t input_since_mark(const Input* in);
+size_t input_consumed(const Input* in);
+void input_set_deadline(Input* in, size_t ms);
+BOOL input_expired(Input* in);
+void input_rewind(Input* in);
+
+#endif
+
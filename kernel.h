@@ -0,0 +1,230 @@
+/*
+ *    table - Command line utility to format and display CSV.
+ *    Copyright (C) 2020  Страхиња Радић
+ *
+ *    This program is free software: you can redistribute it and/or modify it
+ *    under the terms of the GNU General Public License as published by the Free
+ *    Software Foundation, either version 3 of the License, or (at your option)
+ *    any later version.
+ *
+ *    This program is distributed in the hope that it will be useful, but
+ *    WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *    or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *    for more details.
+ *
+ *    You should have received a copy of the GNU General Public License along
+ *    with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Row rendering kernel: render.c includes this once for every combination
+ * of the options a row depends on, so that the loops below test none of
+ * them. Before each inclusion it defines
+ *
+ *   KERNEL(name)  the name to give each function
+ *   KERNEL_TABS   whether tabs are expanded
+ *   KERNEL_WIDTH(t, column)
+ *                 the width of a table column
+ *   KERNEL_BOLD   whether the row is drawn in bold
+ *
+ * as constants where it can. There is deliberately no include guard; the
+ * definitions are dropped at the end, ready for the next inclusion.
+ */
+
+/* Pad the current table column with spaces up to its right edge */
+static void
+KERNEL(pad_column)(const Table* t, Output* out, Cursor* cursor,
+        size_t column_start)
+{
+    size_t column_end = column_start + KERNEL_WIDTH(t, cursor->table_column);
+
+    if (cursor->rune_column < column_end)
+    {
+        output_spaces(out, column_end - cursor->rune_column);
+        cursor->rune_column = column_end;
+    }
+}
+
+/* Render the visible part of field into the current table column */
+static void
+KERNEL(render_field)(const Table* t, Output* out, Cursor* cursor,
+        const uint8_t* record, const Field* field, size_t column_start)
+{
+    const uint8_t* pfield = record + field->offset;
+    const uint8_t* end = pfield + field->length;
+    const uint8_t* span = NULL;
+    size_t column_end = column_start + KERNEL_WIDTH(t, cursor->table_column);
+    size_t text_end = column_end;
+    BOOL marked = FALSE;
+    size_t tab_length = t->options.tab_length;
+    BOOL quoted = (field->flags & FIELD_QUOTED) != 0;
+    BOOL valid = (field->flags & FIELD_UTF8) != 0;
+    BOOL replace = !valid && t->options.invalid == TABLE_INVALID_REPLACE;
+    UINT state = CSV_FIELD;
+    UINT class;
+    ucs4_t uch;
+    int ch_len;
+
+    /* Common case: nothing to strip, expand or replace and the whole field
+     * fits */
+    if (!quoted && !replace
+            && !(KERNEL_TABS && (field->flags & FIELD_TAB))
+            && cursor->rune_column + field->width <= column_end)
+    {
+        output_bytes(out, pfield, field->length);
+        cursor->rune_column += field->width;
+        return;
+    }
+
+    /* A field cut short ends in the marker, if the column has room for it */
+    if (t->ellipsis && cursor->rune_column + field->width > column_end
+            && column_end - cursor->rune_column >= t->ellipsis_width)
+    {
+        text_end = column_end - t->ellipsis_width;
+        marked = TRUE;
+    }
+
+    /* A character that does not fit whole ends the field; zero-width ones
+     * still attach to the last character shown */
+    while (pfield < end)
+    {
+        UINT action = CSV_SHOW;
+
+        if (quoted)
+        {
+            ch_len = csv_class(&t->dialect, pfield, end, valid, &uch,
+                    &class);
+            action = csv_step(&t->dialect, &state, class);
+        }
+
+        if (action == CSV_DROP)
+        {
+            flush_span(out, &span, pfield);
+            pfield += ch_len;
+        }
+        else if (action == CSV_SPACE)
+        {
+            if (cursor->rune_column >= text_end)
+                break;
+            flush_span(out, &span, pfield);
+            output_spaces(out, 1);
+            cursor->rune_column++;
+            pfield += ch_len;
+        }
+        else if (KERNEL_TABS && *pfield == '\t')
+        {
+            size_t tab_end = cursor->rune_column + tab_length
+                - cursor->rune_column % tab_length;
+
+            if (cursor->rune_column >= text_end)
+                break;
+            flush_span(out, &span, pfield);
+            if (tab_end > text_end)
+                tab_end = text_end;
+            output_spaces(out, tab_end - cursor->rune_column);
+            cursor->rune_column = tab_end;
+            pfield++;
+        }
+        else
+        {
+            int width = 1;
+            BOOL invalid = FALSE;
+
+            ch_len = 1;
+            if (*pfield >= 0x80)
+            {
+                ch_len = utf8_decode(pfield, end, valid, &uch);
+                width = char_width(uch);
+                invalid = replace && utf8_invalid(pfield, ch_len, uch);
+            }
+            if (cursor->rune_column + width > text_end)
+                break;
+            /* Bytes that are not UTF-8 show as U+FFFD with --invalid=replace */
+            if (invalid)
+            {
+                flush_span(out, &span, pfield);
+                output_bytes(out, (const uint8_t*)"\xEF\xBF\xBD", 3);
+            }
+            else if (!span)
+                span = pfield;
+            pfield += ch_len;
+            cursor->rune_column += width;
+        }
+    }
+    flush_span(out, &span, pfield);
+    if (pfield < end)
+        STATS_ADD(truncated, 1)
+    if (marked)
+    {
+        output_bytes(out, t->ellipsis, t->ellipsis_len);
+        cursor->rune_column += t->ellipsis_width;
+    }
+}
+
+/* Render a single inner row of the table from the fields of record */
+static void
+KERNEL(render_row)(const Table* t, Output* out, const uint8_t* record,
+        const FieldList* list)
+{
+    const uint8_t* separator =
+        table_inner_symbols[t->options.inner_symbols][1];
+    Cursor cursor = { 0, 0 };
+    size_t column_start = 0;
+
+    STATS_PHASE(phase, STATS_RENDER)
+
+    /* Every row but the header is set off from the one above it */
+    if (t->options.row_separators && t->output_lines > 1)
+        output_bytes(out, t->rules[RULE_SEPARATOR],
+                t->rule_len[RULE_SEPARATOR]);
+
+    output_string(out, table_symbols[t->options.symbols][3]);
+
+    if (KERNEL_BOLD)
+        output_string(out, (uint8_t*)ANSI_SGR_BOLD_ON);
+
+    for (size_t i = 0; i < list->count; i++)
+    {
+        if (i > 0)
+        {
+            if (KERNEL_BOLD)
+                output_string(out, (uint8_t*)ANSI_SGR_BOLD_OFF);
+
+            KERNEL(pad_column)(t, out, &cursor, column_start);
+            column_start++;
+            column_start += KERNEL_WIDTH(t, cursor.table_column);
+            output_string(out, separator);
+            cursor.rune_column++;
+            cursor.table_column++;
+
+            if (KERNEL_BOLD)
+                output_string(out, (uint8_t*)ANSI_SGR_BOLD_ON);
+        }
+        KERNEL(render_field)(t, out, &cursor, record, list->fields + i,
+                column_start);
+    }
+
+    if (KERNEL_BOLD)
+        output_string(out, (uint8_t*)ANSI_SGR_BOLD_OFF);
+
+    while (cursor.table_column < t->table_columns-1)
+    {
+        KERNEL(pad_column)(t, out, &cursor, column_start);
+        output_string(out, separator);
+        column_start++;
+        column_start += KERNEL_WIDTH(t, cursor.table_column);
+        cursor.table_column++;
+        cursor.rune_column++;
+    }
+    KERNEL(pad_column)(t, out, &cursor, column_start);
+
+    output_string(out, table_symbols[t->options.symbols][5]);
+    output_newline(out);
+    STATS_RESUME(phase)
+}
+
+#undef KERNEL
+#undef KERNEL_TABS
+#undef KERNEL_WIDTH
+#undef KERNEL_BOLD
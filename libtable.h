@@ -0,0 +1,89 @@
+/*
+ *    table - Command line utility to format and display CSV.
+ *    Copyright (C) 2020  Страхиња Радић
+ *
+ *    This program is free software: you can redistribute it and/or modify it
+ *    under the terms of the GNU General Public License as published by the Free
+ *    Software Foundation, either version 3 of the License, or (at your option)
+ *    any later version.
+ *
+ *    This program is distributed in the hope that it will be useful, but
+ *    WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *    or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *    for more details.
+ *
+ *    You should have received a copy of the GNU General Public License along
+ *    with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __LIBTABLE_H
+#define __LIBTABLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Rendering options, set to their defaults by table_options_init(). The
+ * fields mirror the command line options of table(1).
+ */
+typedef struct
+{
+    size_t   columns;        /* width of the table in columns (-c) */
+    uint32_t delimiter;      /* field delimiter, a Unicode code point (-d) */
+    const unsigned long* format; /* relative column widths, 0-terminated,
+                                    or NULL (-f) */
+    int      symbols;        /* box drawing set, see table_set_symbols() */
+    int      inner_symbols;
+    int      border_mode;    /* -b */
+    int      bold_header;    /* show the header in bold (not -n) */
+    int      strict;         /* --strict */
+    int      expand_tabs;    /* -t */
+    size_t   tab_length;
+    int      auto_fit;       /* -a */
+    int      exact_fit;      /* --exact-fit */
+    size_t   sample_rows;    /* --sample-rows */
+    size_t   sample_bytes;   /* --sample-bytes */
+    size_t   jobs;           /* -j; only used for memory-mapped files */
+    size_t   repeat_header;  /* --repeat-header */
+    int      row_separators; /* --row-separators */
+    size_t   rows_start;     /* --rows; 0 for all rows */
+    size_t   rows_count;
+    size_t   head_rows;      /* --head; SIZE_MAX for all rows */
+    size_t   tail_rows;      /* --tail */
+    size_t   max_bytes;      /* --max-bytes; 0 for no limit */
+    size_t   max_time;       /* --max-time in milliseconds; 0 for no limit */
+    const char* select;      /* columns to show, or NULL for all (--select) */
+    const char* where;       /* rows to show, or NULL for all (--where) */
+    const char* sort;        /* sort keys, or NULL (--sort) */
+    size_t   sort_memory;    /* bytes of rows sorted in memory (--sort-memory) */
+    const char* ellipsis;    /* ends fields cut short, or NULL (--ellipsis) */
+    int      summary;        /* totals of every column at the end (--summary) */
+    int      invalid;        /* bytes that are not UTF-8, see
+                                table_set_invalid() */
+} TableOptions;
+
+/* Rendering context; each table being rendered needs its own */
+typedef struct Table Table;
+
+/*
+ * Receives rendered output, in pieces of any size. Returns 0, or an errno
+ * value to stop rendering.
+ */
+typedef int (*TableWriteFunc)(void* user, const uint8_t* data, size_t length);
+
+/* The library is built with hidden symbols; these are the ones it exports */
+#define TABLE_EXPORT __attribute__((visibility("default")))
+
+TABLE_EXPORT void table_options_init(TableOptions* options);
+TABLE_EXPORT int table_set_symbols(TableOptions* options, const char* set);
+TABLE_EXPORT int table_set_invalid(TableOptions* options, const char* policy);
+
+TABLE_EXPORT Table* table_new(const TableOptions* options,
+        TableWriteFunc write, void* user);
+TABLE_EXPORT int table_feed(Table* table, const uint8_t* data, size_t length);
+TABLE_EXPORT int table_finish(Table* table);
+TABLE_EXPORT const char* table_error(const Table* table);
+TABLE_EXPORT void table_free(Table* table);
+
+#endif
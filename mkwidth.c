@@ -0,0 +1,94 @@
+/*
+ *    table - Command line utility to format and display CSV.
+ *    Copyright (C) 2020  Страхиња Радић
+ *
+ *    This program is free software: you can redistribute it and/or modify it
+ *    under the terms of the GNU General Public License as published by the Free
+ *    Software Foundation, either version 3 of the License, or (at your option)
+ *    any later version.
+ *
+ *    This program is distributed in the hope that it will be useful, but
+ *    WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *    or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *    for more details.
+ *
+ *    You should have received a copy of the GNU General Public License along
+ *    with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Generator for widthtab.c, the display width table used by char_width().
+ * Widths come from uc_width() of the libunistring the program is built
+ * against. Code points are grouped in blocks of WIDTH_BLOCK_SIZE; identical
+ * blocks are stored once and looked up through an index by block number.
+ */
+
+#include "defs.h"
+#include "width.h"
+
+#define BLOCK_BYTES (WIDTH_BLOCK_SIZE / 4)
+#define MAX_BLOCKS  256
+
+static UBYTE blocks[MAX_BLOCKS][BLOCK_BYTES];
+static UBYTE block_index[WIDTH_INDEX_SIZE];
+static size_t block_count = 0;
+
+static int
+width_of(ucs4_t uc)
+{
+    int width;
+
+    if (uc < 0x80)
+        return 1;
+    width = uc_width(uc, "UTF-8");
+    return width < 0 ? 0 : width;
+}
+
+int
+main()
+{
+    UBYTE block[BLOCK_BYTES];
+
+    for (size_t b = 0; b < WIDTH_INDEX_SIZE; b++)
+    {
+        size_t found;
+
+        memset(block, 0, sizeof(block));
+        for (size_t i = 0; i < WIDTH_BLOCK_SIZE; i++)
+            block[i / 4] |= width_of(b * WIDTH_BLOCK_SIZE + i) << (i % 4 * 2);
+
+        for (found = 0; found < block_count; found++)
+            if (!memcmp(blocks[found], block, sizeof(block)))
+                break;
+        if (found == block_count)
+        {
+            if (block_count == MAX_BLOCKS)
+            {
+                fprintf(stderr, "mkwidth: too many distinct blocks\n");
+                return 1;
+            }
+            memcpy(blocks[block_count++], block, sizeof(block));
+        }
+        block_index[b] = found;
+    }
+
+    printf("/* Generated by mkwidth; do not edit */\n\n");
+    printf("#include \"width.h\"\n\n");
+    printf("const UBYTE width_index[WIDTH_INDEX_SIZE] =\n{");
+    for (size_t b = 0; b < WIDTH_INDEX_SIZE; b++)
+        printf("%s%3u,", b % 16 ? " " : "\n    ", block_index[b]);
+    printf("\n};\n\n");
+    printf("const UBYTE width_blocks[][%d] =\n{\n", BLOCK_BYTES);
+    for (size_t found = 0; found < block_count; found++)
+    {
+        printf("    {");
+        for (size_t i = 0; i < BLOCK_BYTES; i++)
+            printf("%s0x%02x,", i % 8 ? " " : "\n        ", blocks[found][i]);
+        printf("\n    },\n");
+    }
+    printf("};\n");
+
+    return 0;
+}
+
@@ -0,0 +1,140 @@
+/*
+ *    table - Command line utility to format and display CSV.
+ *    Copyright (C) 2020  Страхиња Радић
+ *
+ *    This program is free software: you can redistribute it and/or modify it
+ *    under the terms of the GNU General Public License as published by the Free
+ *    Software Foundation, either version 3 of the License, or (at your option)
+ *    any later version.
+ *
+ *    This program is distributed in the hope that it will be useful, but
+ *    WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *    or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *    for more details.
+ *
+ *    You should have received a copy of the GNU General Public License along
+ *    with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "output.h"
+
+void
+output_init(Output* out, int fd)
+{
+    out->size = OUTPUT_BLOCKSIZE + BUFSIZE;
+    out->length = 0;
+    out->fd = fd;
+    out->line_flush = isatty(fd) ? TRUE : FALSE;
+    out->write = NULL;
+    out->user = NULL;
+    out->error = 0;
+    CALLOC(out->buffer, uint8_t, out->size)
+}
+
+/* Hand flushed output to write(user, ...) instead of a file descriptor */
+void
+output_init_func(Output* out, OutputFunc write, void* user)
+{
+    output_init(out, -1);
+    out->write = write;
+    out->user = user;
+}
+
+void
+output_free(Output* out)
+{
+    output_flush(out);
+    free(out->buffer);
+    out->buffer = NULL;
+    out->size = 0;
+}
+
+int
+output_flush(Output* out)
+{
+    uint8_t* pbuffer = out->buffer;
+
+    if (out->write)
+    {
+        STATS_ADD(bytes_written, out->length)
+        if (out->length && !out->error)
+            out->error = out->write(out->user, out->buffer, out->length);
+        out->length = 0;
+        return out->error;
+    }
+    if (out->fd < 0)
+        return 0;
+
+    STATS_ADD(bytes_written, out->length)
+
+    while (out->length)
+    {
+        ssize_t written = write(out->fd, pbuffer, out->length);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            /* Reader went away (EPIPE) or the device is full; nothing more
+             * can be shown, so stop quietly like printf would on SIGPIPE */
+            exit(errno == EPIPE ? 0 : table_report(errno,
+                        (uint8_t*)"Write error: %s", strerror(errno)));
+        }
+        pbuffer += written;
+        out->length -= written;
+    }
+
+    return 0;
+}
+
+void
+output_reserve(Output* out, size_t len)
+{
+    if (out->length + len <= out->size)
+        return;
+
+    while (out->length + len > out->size)
+        out->size *= 2;
+    REALLOC(out->buffer, uint8_t, out->size)
+}
+
+void
+output_bytes(Output* out, const uint8_t* bytes, size_t len)
+{
+    output_reserve(out, len);
+    memcpy(out->buffer + out->length, bytes, len);
+    out->length += len;
+}
+
+void
+output_string(Output* out, const uint8_t* s)
+{
+    output_bytes(out, s, strlen((const char*)s));
+}
+
+void
+output_spaces(Output* out, size_t count)
+{
+    output_reserve(out, count);
+    memset(out->buffer + out->length, ' ', count);
+    out->length += count;
+}
+
+/* Copy a whole line, newline included, flushing as output_newline() does */
+void
+output_line(Output* out, const uint8_t* line, size_t len)
+{
+    output_bytes(out, line, len);
+    if (out->line_flush || out->length >= OUTPUT_BLOCKSIZE)
+        output_flush(out);
+}
+
+void
+output_newline(Output* out)
+{
+    output_reserve(out, 1);
+    out->buffer[out->length++] = '\n';
+    if (out->line_flush || out->length >= OUTPUT_BLOCKSIZE)
+        output_flush(out);
+}
+
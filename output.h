@@ -0,0 +1,62 @@
+/*
+ *    table - Command line utility to format and display CSV.
+ *    Copyright (C) 2020  Страхиња Радић
+ *
+ *    This program is free software: you can redistribute it and/or modify it
+ *    under the terms of the GNU General Public License as published by the Free
+ *    Software Foundation, either version 3 of the License, or (at your option)
+ *    any later version.
+ *
+ *    This program is distributed in the hope that it will be useful, but
+ *    WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *    or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *    for more details.
+ *
+ *    You should have received a copy of the GNU General Public License along
+ *    with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __OUTPUT_H
+#define __OUTPUT_H
+
+#include "defs.h"
+
+/* Flush threshold for non-interactive outputs (pipes, files) */
+#define OUTPUT_BLOCKSIZE (64 * 1024)
+
+/* Receives flushed output instead of fd; returns 0 or an errno value */
+typedef int (*OutputFunc)(void* user, const uint8_t* data, size_t length);
+
+/*
+ * Output sink. Rendered rows are assembled in buffer and written out with
+ * write(2) either after every line (when fd is a terminal) or whenever
+ * OUTPUT_BLOCKSIZE bytes have accumulated. With fd -1 everything is kept in
+ * buffer until the caller decides where it goes, unless a write function
+ * takes the place of fd.
+ */
+typedef struct
+{
+    uint8_t*   buffer;
+    size_t     size;
+    size_t     length;
+    int        fd;
+    BOOL       line_flush;
+    OutputFunc write;
+    void*      user;
+    int        error;  /* first error returned by write */
+} Output;
+
+void output_init(Output* out, int fd);
+void output_init_func(Output* out, OutputFunc write, void* user);
+void output_free(Output* out);
+int output_flush(Output* out);
+void output_reserve(Output* out, size_t len);
+void output_bytes(Output* out, const uint8_t* bytes, size_t len);
+void output_string(Output* out, const uint8_t* s);
+void output_spaces(Output* out, size_t count);
+void output_line(Output* out, const uint8_t* line, size_t len);
+void output_newline(Output* out);
+
+#endif
+
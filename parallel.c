@@ -0,0 +1,385 @@
+/*
+ *    table - Command line utility to format and display CSV.
+ *    Copyright (C) 2020  Страхиња Радић
+ *
+ *    This program is free software: you can redistribute it and/or modify it
+ *    under the terms of the GNU General Public License as published by the Free
+ *    Software Foundation, either version 3 of the License, or (at your option)
+ *    any later version.
+ *
+ *    This program is distributed in the hope that it will be useful, but
+ *    WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *    or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *    for more details.
+ *
+ *    You should have received a copy of the GNU General Public License along
+ *    with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <pthread.h>
+#include "parallel.h"
+#include "scan.h"
+
+typedef struct
+{
+    const uint8_t* data;
+    size_t         length;
+    BOOL           done;
+    Output         out;
+} Chunk;
+
+/*
+ * Shared state of the worker pool. Workers cut the input into chunks at
+ * record boundaries and render them into the slots of a ring; the writer
+ * empties the slots in input order. A slot is reused only after it has
+ * been written, which bounds memory to window chunks. The end of a chunk
+ * is looked for outside of the lock, by one worker at a time: the next
+ * chunk starts there.
+ */
+typedef struct
+{
+    const uint8_t*  data;
+    size_t          length;
+    size_t          position;   /* start of the next chunk */
+    BOOL            splitting;  /* a worker is looking for position */
+    ucs4_t          delimiter;  /* of fields, for scan_quoting() */
+    ChunkFunc       render;
+    void*           context;    /* passed on to render */
+    Chunk*          chunks;
+    size_t          window;
+    size_t          next;       /* number of chunks handed out */
+    size_t          written;    /* number of chunks written */
+    pthread_mutex_t lock;
+    pthread_cond_t  ready;      /* a chunk has been rendered */
+    pthread_cond_t  space;      /* a slot has been written or a chunk
+                                   has been split off */
+} Pool;
+
+/* Number of workers to use; 0 means one per online CPU */
+size_t
+parallel_jobs(size_t jobs)
+{
+    long cpus;
+
+    if (jobs)
+        return jobs;
+    cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    return cpus > 0 ? (size_t)cpus : 1;
+}
+
+/*
+ * End of the chunk starting at start: the first record end after the chunk
+ * size, or the end of the data. Chunks start at a record, so a line break
+ * ends one unless scan_quoting() finds it within a quoted field.
+ */
+static size_t
+chunk_end(const Pool* pool, size_t start)
+{
+    const uint8_t* data = pool->data;
+    size_t position = start + PARALLEL_CHUNKSIZE;
+    UINT quoting = SCAN_FIELD;
+    const uint8_t* eol;
+
+    if (pool->length - start <= PARALLEL_CHUNKSIZE)
+        return pool->length;
+    while ((eol = memchr(data + position, '\n', pool->length - position)))
+    {
+        quoting = scan_quoting(data + start, eol - (data + start),
+                pool->delimiter, quoting);
+        start = position = eol - data + 1;
+        if (quoting != SCAN_QUOTED)
+            return position;
+    }
+    return pool->length;
+}
+
+static void*
+worker(void* arg)
+{
+    Pool* pool = arg;
+
+    pthread_mutex_lock(&pool->lock);
+    for (;;)
+    {
+        Chunk* chunk;
+        size_t start;
+        size_t end;
+
+        while (pool->splitting || (pool->position < pool->length
+                    && pool->next >= pool->written + pool->window))
+            pthread_cond_wait(&pool->space, &pool->lock);
+        if (pool->position >= pool->length)
+            break;
+
+        chunk = pool->chunks + pool->next++ % pool->window;
+        chunk->done = FALSE;
+        start = pool->position;
+        pool->splitting = TRUE;
+        pthread_mutex_unlock(&pool->lock);
+
+        end = chunk_end(pool, start);
+        chunk->data = pool->data + start;
+        chunk->length = end - start;
+
+        pthread_mutex_lock(&pool->lock);
+        pool->position = end;
+        pool->splitting = FALSE;
+        pthread_cond_broadcast(&pool->space);
+        pthread_mutex_unlock(&pool->lock);
+
+        pool->render(pool->context, chunk->data, chunk->length, &chunk->out);
+
+        pthread_mutex_lock(&pool->lock);
+        chunk->done = TRUE;
+        pthread_cond_broadcast(&pool->ready);
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    return NULL;
+}
+
+/*
+ * Render data, which must consist of whole records separated as delimiter
+ * says, on jobs worker threads and write the result to out in the original
+ * order
+ */
+void
+render_parallel(const uint8_t* data, size_t length, ucs4_t delimiter,
+        size_t jobs, ChunkFunc render, void* context, Output* out)
+{
+    Pool pool;
+    pthread_t* threads = NULL;
+    size_t started = 0;
+
+    memset(&pool, 0, sizeof(Pool));
+    pool.data = data;
+    pool.length = length;
+    pool.delimiter = delimiter;
+    pool.render = render;
+    pool.context = context;
+    pool.window = jobs * PARALLEL_WINDOW;
+    pthread_mutex_init(&pool.lock, NULL);
+    pthread_cond_init(&pool.ready, NULL);
+    pthread_cond_init(&pool.space, NULL);
+    CALLOC(pool.chunks, Chunk, pool.window)
+    CALLOC(threads, pthread_t, jobs)
+    for (size_t i = 0; i < pool.window; i++)
+        output_init(&pool.chunks[i].out, -1);
+
+    for (size_t i = 0; i < jobs; i++)
+        if (!pthread_create(threads + i, NULL, worker, &pool))
+            started++;
+    if (!started)
+        render(context, data, length, out);
+
+    /* What is already in out comes before the first chunk */
+    output_flush(out);
+
+    pthread_mutex_lock(&pool.lock);
+    while (started)
+    {
+        Chunk* chunk = pool.chunks + pool.written % pool.window;
+
+        if (pool.written == pool.next && pool.position >= pool.length)
+            break;
+        if (pool.written == pool.next || !chunk->done)
+        {
+            pthread_cond_wait(&pool.ready, &pool.lock);
+            continue;
+        }
+        pthread_mutex_unlock(&pool.lock);
+
+        chunk->out.fd = out->fd;
+        output_flush(&chunk->out);
+        chunk->out.fd = -1;
+
+        pthread_mutex_lock(&pool.lock);
+        pool.written++;
+        pthread_cond_broadcast(&pool.space);
+    }
+    pthread_mutex_unlock(&pool.lock);
+
+    for (size_t i = 0; i < started; i++)
+        pthread_join(threads[i], NULL);
+    for (size_t i = 0; i < pool.window; i++)
+        output_free(&pool.chunks[i].out);
+    free(threads);
+    free(pool.chunks);
+    pthread_cond_destroy(&pool.space);
+    pthread_cond_destroy(&pool.ready);
+    pthread_mutex_destroy(&pool.lock);
+}
+
+
+typedef struct Queue Queue;
+
+/* Output of a job of render_ordered(), kept until the jobs before it are out */
+typedef struct
+{
+    Queue*  queue;
+    Output  out;
+    BOOL    done;
+    int     status;
+} Job;
+
+/*
+ * Shared state of render_ordered(). Workers take jobs in order and render
+ * each into a buffer of its own; the writer empties the buffers in job
+ * order. A worker waits while its buffer holds PARALLEL_CHUNKSIZE bytes,
+ * which bounds memory to about that much per worker.
+ */
+struct Queue
+{
+    JobFunc         render;
+    void*           context;    /* passed on to render */
+    Job*            jobs;
+    size_t          count;
+    size_t          next;       /* number of jobs handed out */
+    pthread_mutex_t lock;
+    pthread_cond_t  ready;      /* a job has output, or has ended */
+    pthread_cond_t  space;      /* a buffer has been written */
+};
+
+static int
+job_write(void* user, const uint8_t* data, size_t length)
+{
+    Job* job = user;
+    Queue* queue = job->queue;
+
+    pthread_mutex_lock(&queue->lock);
+    while (job->out.length >= PARALLEL_CHUNKSIZE)
+        pthread_cond_wait(&queue->space, &queue->lock);
+    output_bytes(&job->out, data, length);
+    pthread_cond_broadcast(&queue->ready);
+    pthread_mutex_unlock(&queue->lock);
+
+    return 0;
+}
+
+/* Used when no worker could be started: jobs write straight to out */
+static int
+direct_write(void* user, const uint8_t* data, size_t length)
+{
+    Output* out = user;
+
+    output_bytes(out, data, length);
+    return output_flush(out);
+}
+
+static void*
+job_worker(void* arg)
+{
+    Queue* queue = arg;
+
+    pthread_mutex_lock(&queue->lock);
+    while (queue->next < queue->count)
+    {
+        size_t index = queue->next++;
+        Job* job = queue->jobs + index;
+        int status;
+
+        output_init(&job->out, -1);
+        pthread_mutex_unlock(&queue->lock);
+
+        status = queue->render(queue->context, index, job_write, job);
+
+        pthread_mutex_lock(&queue->lock);
+        job->status = status;
+        job->done = TRUE;
+        pthread_cond_broadcast(&queue->ready);
+    }
+    pthread_mutex_unlock(&queue->lock);
+
+    return NULL;
+}
+
+/*
+ * Render count jobs on up to jobs worker threads and write their output to
+ * out in job order. Returns the first nonzero status of a job, or 0.
+ */
+int
+render_ordered(size_t count, size_t jobs, JobFunc render, void* context,
+        Output* out)
+{
+    Queue queue;
+    Output spare;
+    pthread_t* threads = NULL;
+    size_t started = 0;
+    int status = 0;
+
+    if (jobs > count)
+        jobs = count;
+
+    memset(&queue, 0, sizeof(Queue));
+    queue.render = render;
+    queue.context = context;
+    queue.count = count;
+    pthread_mutex_init(&queue.lock, NULL);
+    pthread_cond_init(&queue.ready, NULL);
+    pthread_cond_init(&queue.space, NULL);
+    CALLOC(queue.jobs, Job, count)
+    CALLOC(threads, pthread_t, jobs ? jobs : 1)
+    for (size_t i = 0; i < count; i++)
+        queue.jobs[i].queue = &queue;
+    output_init(&spare, -1);
+
+    for (size_t i = 0; i < jobs; i++)
+        if (!pthread_create(threads + i, NULL, job_worker, &queue))
+            started++;
+
+    output_flush(out);
+
+    for (size_t i = 0; i < count; i++)
+    {
+        Job* job = queue.jobs + i;
+        int job_status;
+
+        if (!started)
+        {
+            job_status = render(context, i, direct_write, out);
+            if (job_status && !status)
+                status = job_status;
+            continue;
+        }
+
+        pthread_mutex_lock(&queue.lock);
+        for (;;)
+        {
+            Output written;
+            BOOL done;
+
+            while (!job->done && !job->out.length)
+                pthread_cond_wait(&queue.ready, &queue.lock);
+            done = job->done;
+            written = job->out;
+            job->out = spare;
+            spare = written;
+            pthread_cond_broadcast(&queue.space);
+            pthread_mutex_unlock(&queue.lock);
+
+            spare.fd = out->fd;
+            output_flush(&spare);
+            spare.fd = -1;
+
+            if (done)
+                break;
+            pthread_mutex_lock(&queue.lock);
+        }
+
+        if (job->status && !status)
+            status = job->status;
+        output_free(&job->out);
+    }
+
+    for (size_t i = 0; i < started; i++)
+        pthread_join(threads[i], NULL);
+    output_free(&spare);
+    free(threads);
+    free(queue.jobs);
+    pthread_cond_destroy(&queue.space);
+    pthread_cond_destroy(&queue.ready);
+    pthread_mutex_destroy(&queue.lock);
+
+    return status;
+}
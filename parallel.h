@@ -0,0 +1,47 @@
+/*
+ *    table - Command line utility to format and display CSV.
+ *    Copyright (C) 2020  Страхиња Радић
+ *
+ *    This program is free software: you can redistribute it and/or modify it
+ *    under the terms of the GNU General Public License as published by the Free
+ *    Software Foundation, either version 3 of the License, or (at your option)
+ *    any later version.
+ *
+ *    This program is distributed in the hope that it will be useful, but
+ *    WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *    or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *    for more details.
+ *
+ *    You should have received a copy of the GNU General Public License along
+ *    with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __PARALLEL_H
+#define __PARALLEL_H
+
+#include "defs.h"
+#include "output.h"
+
+/* Amount of input handed to a worker at a time */
+#define PARALLEL_CHUNKSIZE (1024 * 1024)
+
+/* Chunks rendered ahead of the one being written, per worker */
+#define PARALLEL_WINDOW 2
+
+/* Renders whole records from data into out */
+typedef void (*ChunkFunc)(void* context, const uint8_t* data, size_t length,
+        Output* out);
+
+/* Renders job number index through write; returns the status it ended with */
+typedef int (*JobFunc)(void* context, size_t index, OutputFunc write,
+        void* user);
+
+size_t parallel_jobs(size_t jobs);
+void render_parallel(const uint8_t* data, size_t length, ucs4_t delimiter,
+        size_t jobs, ChunkFunc render, void* context, Output* out);
+int render_ordered(size_t count, size_t jobs, JobFunc render, void* context,
+        Output* out);
+
+#endif
+
@@ -0,0 +1,558 @@
+/*
+ *    table - Command line utility to format and display CSV.
+ *    Copyright (C) 2020  Страхиња Радић
+ *
+ *    This program is free software: you can redistribute it and/or modify it
+ *    under the terms of the GNU General Public License as published by the Free
+ *    Software Foundation, either version 3 of the License, or (at your option)
+ *    any later version.
+ *
+ *    This program is distributed in the hope that it will be useful, but
+ *    WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *    or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *    for more details.
+ *
+ *    You should have received a copy of the GNU General Public License along
+ *    with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "parse.h"
+#include "scan.h"
+#include "width.h"
+
+/* Shorthands for the transition tables */
+#define F  CSV_FIELD
+#define U  CSV_UNQUOTED
+#define Q  CSV_QUOTED
+#define QR CSV_QUOTED_CR
+#define QQ CSV_QUOTED_QUOTE
+#define E  CSV_ERROR
+#define T(state, action) (((state) << 2) | CSV_##action)
+
+/*
+ * RFC 4180 with the usual liberties: a '"' within an unquoted field is
+ * kept as it is, text after a closing '"' belongs to the same field and a
+ * quoted field left open runs to the end of the input
+ */
+static const uint8_t lenient[CSV_STATES][CSV_CLASSES] =
+{
+    /*       other        quote        delimiter    CR           LF */
+    [F]  = { T(U, SHOW),  T(Q, DROP),  T(F, SPLIT), T(U, SHOW),  T(U, SPACE) },
+    [U]  = { T(U, SHOW),  T(U, SHOW),  T(F, SPLIT), T(U, SHOW),  T(U, SPACE) },
+    [Q]  = { T(Q, SHOW),  T(QQ, DROP), T(Q, SHOW),  T(QR, SPACE), T(Q, SPACE) },
+    [QR] = { T(Q, SHOW),  T(QQ, DROP), T(Q, SHOW),  T(QR, SPACE), T(Q, DROP) },
+    [QQ] = { T(U, SHOW),  T(Q, SHOW),  T(F, SPLIT), T(U, SHOW),  T(U, SPACE) },
+    [E]  = { T(E, SHOW),  T(E, SHOW),  T(E, SHOW),  T(E, SHOW),  T(E, SPACE) },
+};
+
+/*
+ * RFC 4180 to the letter: quotes only around whole fields, nothing but a
+ * delimiter after the closing one
+ */
+static const uint8_t strict[CSV_STATES][CSV_CLASSES] =
+{
+    /*       other        quote        delimiter    CR           LF */
+    [F]  = { T(U, SHOW),  T(Q, DROP),  T(F, SPLIT), T(U, SHOW),  T(E, SPACE) },
+    [U]  = { T(U, SHOW),  T(E, SHOW),  T(F, SPLIT), T(U, SHOW),  T(E, SPACE) },
+    [Q]  = { T(Q, SHOW),  T(QQ, DROP), T(Q, SHOW),  T(QR, SPACE), T(Q, SPACE) },
+    [QR] = { T(Q, SHOW),  T(QQ, DROP), T(Q, SHOW),  T(QR, SPACE), T(Q, DROP) },
+    [QQ] = { T(E, SHOW),  T(Q, SHOW),  T(F, SPLIT), T(E, SHOW),  T(E, SPACE) },
+    [E]  = { T(E, SHOW),  T(E, SHOW),  T(E, SHOW),  T(E, SHOW),  T(E, SPACE) },
+};
+
+#undef F
+#undef U
+#undef Q
+#undef QR
+#undef QQ
+#undef E
+#undef T
+
+void
+dialect_init(Dialect* dialect, ucs4_t delimiter, BOOL strict_mode)
+{
+    memset(dialect->classes, CSV_OTHER, sizeof(dialect->classes));
+    dialect->classes['"'] = CSV_QUOTE;
+    dialect->classes['\r'] = CSV_CR;
+    dialect->classes['\n'] = CSV_LF;
+    if (delimiter < 0x80)
+        dialect->classes[delimiter] = CSV_DELIM;
+    dialect->delimiter = delimiter;
+    dialect->strict = strict_mode;
+    dialect->validate = FALSE;
+    dialect->max_width = SIZE_MAX;
+    dialect->transitions = strict_mode ? strict : lenient;
+}
+
+void
+field_list_init(FieldList* list)
+{
+    list->count = 0;
+    list->size = SMALL_BUFSIZE;
+    CALLOC(list->fields, Field, list->size)
+}
+
+void
+field_list_free(FieldList* list)
+{
+    free(list->fields);
+    list->fields = NULL;
+    list->count = list->size = 0;
+}
+
+static inline Field*
+field_list_add(FieldList* list, size_t offset)
+{
+    Field* field;
+
+    if (list->count == list->size)
+    {
+        list->size *= 2;
+        REALLOCARRAY(list->fields, Field, list->size)
+    }
+    field = list->fields + list->count++;
+    field->offset = offset;
+    field->length = 0;
+    field->width = 0;
+    field->flags = 0;
+    return field;
+}
+
+/*
+ * Display width of a field that contains quotes or non-ASCII characters,
+ * run through the state machine; valid tells if the field is known to be
+ * UTF-8. Sets *malformed if a strict dialect rejects the field. Past
+ * max_width, the rest of the field is left undecoded unless a strict
+ * dialect has to check it.
+ */
+static size_t
+field_width(const Dialect* dialect, const uint8_t* pfield, const uint8_t* end,
+        BOOL valid, BOOL* malformed)
+{
+    size_t width = 0;
+    UINT state = CSV_FIELD;
+    UINT class;
+    ucs4_t uch;
+
+    while (pfield < end)
+    {
+        if (width > dialect->max_width && !dialect->strict)
+            return width;
+        pfield += csv_class(dialect, pfield, end, valid, &uch, &class);
+        switch (csv_step(dialect, &state, class))
+        {
+        case CSV_DROP:
+            break;
+        case CSV_SPACE:
+            width++;
+            break;
+        default:
+            width += uch < 0x80 ? 1 : char_width(uch);
+        }
+    }
+
+    if (state == CSV_ERROR
+            || (dialect->strict
+                && (state == CSV_QUOTED || state == CSV_QUOTED_CR)))
+        *malformed = TRUE;
+    return width;
+}
+
+/*
+ * Display width of a field of valid UTF-8 without quotes, which has no
+ * need of the state machine; measured up to just past max_width
+ */
+static size_t
+text_width(const Dialect* dialect, const uint8_t* pfield, const uint8_t* end)
+{
+    size_t width = 0;
+    ucs4_t uch;
+
+    while (pfield < end && width <= dialect->max_width)
+    {
+        if (*pfield < 0x80)
+        {
+            width++;
+            pfield++;
+            continue;
+        }
+        pfield += utf8_decode(pfield, end, TRUE, &uch);
+        width += char_width(uch);
+    }
+    return width;
+}
+
+/* Check record to be UTF-8, unless it has been already */
+static inline void
+check_text(const uint8_t* record, size_t length, BOOL* checked,
+        FieldList* list)
+{
+    if (!*checked)
+        list->invalid = scan_text(record, length) == TEXT_INVALID;
+    *checked = TRUE;
+}
+
+/* Bits from..63 of a block mask; from may be SCAN_BLOCKSIZE */
+#define MASK_FROM(from) ((from) < SCAN_BLOCKSIZE ? ~0ULL << (from) : 0)
+
+/* Whether field (counted from 0) is wanted; see parse_record() */
+#define MEASURED(measure, field) (!(measure) || (measure)[field])
+
+/*
+ * Parser for an ASCII delimiter. Blocks of the record are classified by the
+ * SIMD scanner and the parser only visits delimiters and quotes; the bytes
+ * between them are measured by their masks instead of being decoded. A quote
+ * opens quoting at the start of a field or right after the quote that closed it
+ * (as an escaped one), and a delimiter splits outside of quoting, which is
+ * where the state machine would split too, so the machine is only run over
+ * fields with quotes, to measure them. The masks also tell which fields are
+ * ASCII; the record is only checked to be UTF-8 if a field that is measured is
+ * not, or if the dialect asks for every record.
+ */
+static size_t
+parse_record_ascii(const uint8_t* record, size_t length,
+        const Dialect* dialect, size_t max_fields, const uint8_t* measure,
+        FieldList* list)
+{
+    uint8_t delimiter = (uint8_t)dialect->delimiter;
+    Field* field = NULL;
+    BOOL quote = FALSE;
+    size_t closed = SIZE_MAX; /* offset right after a closing quote */
+    size_t quotes = 0;
+    uint64_t high = 0;
+    uint64_t tab = 0;
+    BOOL checked = FALSE;
+    ScanMasks masks;
+
+    list->count = 0;
+    list->malformed = list->invalid = FALSE;
+    field = field_list_add(list, 0);
+    if (dialect->validate)
+        check_text(record, length, &checked, list);
+
+    for (size_t block = 0; block < length; block += SCAN_BLOCKSIZE)
+    {
+        size_t from = field->offset > block ? field->offset - block : 0;
+        uint64_t structural;
+
+        /* The last field takes the rest; if it is not wanted, it need not
+         * be looked at (except to check it in a strict dialect) */
+        if (list->count >= max_fields && !MEASURED(measure, list->count-1)
+                && !dialect->strict)
+        {
+            field->length = length - field->offset;
+            return list->count;
+        }
+
+        if (length - block >= SCAN_BLOCKSIZE)
+            scan_block(record + block, delimiter, &masks);
+        else
+            scan_tail(record + block, length - block, delimiter, &masks);
+
+        structural = masks.delimiter | masks.quote;
+        while (structural)
+        {
+            size_t bit = __builtin_ctzll(structural);
+            uint64_t range = MASK_FROM(from) & ((1ULL << bit) - 1);
+
+            structural &= structural - 1;
+            if (masks.quote & (1ULL << bit))
+            {
+                if (quote)
+                {
+                    quote = FALSE;
+                    closed = block + bit + 1;
+                }
+                else if (block + bit == field->offset
+                        || block + bit == closed)
+                    quote = TRUE;
+                quotes++;
+                continue;
+            }
+            if (quote || list->count >= max_fields)
+                continue;
+
+            high |= masks.high & range;
+            tab |= masks.tab & range;
+            field->length = block + bit - field->offset;
+            if (MEASURED(measure, list->count-1)
+                    || (quotes && dialect->strict))
+            {
+                BOOL valid;
+
+                if (high)
+                    check_text(record, length, &checked, list);
+                valid = !list->invalid || !high;
+                if (quotes || (high && !valid))
+                    field->width = field_width(dialect,
+                            record + field->offset,
+                            record + field->offset + field->length, valid,
+                            &list->malformed);
+                else if (high)
+                    field->width = text_width(dialect,
+                            record + field->offset,
+                            record + field->offset + field->length);
+                else
+                    field->width = field->length;
+                field->flags = (quotes ? FIELD_QUOTED : 0)
+                    | (tab ? FIELD_TAB : 0) | (valid ? FIELD_UTF8 : 0);
+            }
+
+            field = field_list_add(list, block + bit + 1);
+            from = bit + 1;
+            quotes = 0;
+            high = tab = 0;
+        }
+
+        high |= masks.high & MASK_FROM(from);
+        tab |= masks.tab & MASK_FROM(from);
+    }
+
+    field->length = length - field->offset;
+    if (MEASURED(measure, list->count-1) || (quotes && dialect->strict))
+    {
+        BOOL valid;
+
+        if (high)
+            check_text(record, length, &checked, list);
+        valid = !list->invalid || !high;
+        if (quotes || (high && !valid))
+            field->width = field_width(dialect, record + field->offset,
+                    record + length, valid, &list->malformed);
+        else if (high)
+            field->width = text_width(dialect, record + field->offset,
+                    record + length);
+        else
+            field->width = field->length;
+        field->flags = (quotes ? FIELD_QUOTED : 0) | (tab ? FIELD_TAB : 0)
+            | (valid ? FIELD_UTF8 : 0);
+    }
+
+    return list->count;
+}
+
+/*
+ * Character by character parser, used when the delimiter is not ASCII: the
+ * state machine is stepped for every character
+ */
+static size_t
+parse_record_generic(const uint8_t* record, size_t length,
+        const Dialect* dialect, size_t max_fields, const uint8_t* measure,
+        FieldList* list)
+{
+    const uint8_t* precord = record;
+    const uint8_t* end = record + length;
+    Field* field = NULL;
+    UINT state = CSV_FIELD;
+    UINT class;
+    ucs4_t uch;
+    int ch_len;
+    BOOL measured = MEASURED(measure, 0);
+    UINT utf8 = list->invalid ? 0 : FIELD_UTF8;
+
+    list->count = 0;
+    list->malformed = FALSE;
+    field = field_list_add(list, 0);
+    field->flags = utf8;
+
+    while (precord < end)
+    {
+        if (list->count >= max_fields && !measured && !dialect->strict)
+            break;
+        ch_len = csv_class(dialect, precord, end, !list->invalid, &uch,
+                &class);
+
+        switch (csv_step(dialect, &state, class))
+        {
+        case CSV_SPLIT:
+            if (list->count < max_fields)
+            {
+                field->length = precord - record - field->offset;
+                field = field_list_add(list, precord - record + ch_len);
+                field->flags = utf8;
+                measured = MEASURED(measure, list->count-1);
+                break;
+            }
+            if (measured && field->width <= dialect->max_width)
+                field->width += char_width(uch);
+            break;
+        case CSV_DROP:
+            field->flags |= FIELD_QUOTED;
+            break;
+        case CSV_SPACE:
+            field->flags |= FIELD_QUOTED;
+            field->width++;
+            break;
+        default:
+            if (uch == '\t')
+                field->flags |= FIELD_TAB;
+            if (measured && field->width <= dialect->max_width)
+                field->width += char_width(uch);
+        }
+        if (state == CSV_ERROR)
+            list->malformed = TRUE;
+        precord += ch_len;
+    }
+    field->length = end - record - field->offset;
+    if (dialect->strict && (state == CSV_QUOTED || state == CSV_QUOTED_CR))
+        list->malformed = TRUE;
+
+    return list->count;
+}
+
+/*
+ * Split record into fields in a single pass. Quoting follows the state
+ * machine of dialect: delimiters inside quotes do not split, and quotes
+ * are not counted in the width except for escaped ("") ones. Once
+ * max_fields fields have been started, the last one takes the rest of the
+ * record, delimiters included. Unless measure is NULL, only fields i with
+ * measure[i] set (for i below max_fields) get their width and flags; the
+ * others are only delimited. Only the characters of records that are not
+ * valid UTF-8 get decoded with checks. Returns the number of fields.
+ */
+size_t
+parse_record(const uint8_t* record, size_t length, const Dialect* dialect,
+        size_t max_fields, const uint8_t* measure, FieldList* list)
+{
+    if (dialect->delimiter < 0x80)
+        return parse_record_ascii(record, length, dialect, max_fields,
+                measure, list);
+    list->invalid = scan_text(record, length) == TEXT_INVALID;
+    return parse_record_generic(record, length, dialect, max_fields, measure,
+            list);
+}
+
+/*
+ * Copy the text of a field to out, which has room for length bytes, leaving
+ * out the quoting. Returns the length of the text.
+ */
+size_t
+field_unquote(const uint8_t* text, size_t length, uint8_t* out)
+{
+    const uint8_t* start = text;
+    const uint8_t* end = text + length;
+    uint8_t* pout = out;
+    BOOL quoted = FALSE;
+
+    while (text < end)
+    {
+        if (*text != '"' || (!quoted && text != start))
+            *pout++ = *text++;
+        else if (quoted && text + 1 < end && text[1] == '"')
+        {
+            *pout++ = '"';
+            text += 2;
+        }
+        else
+        {
+            quoted = !quoted;
+            text++;
+        }
+    }
+    return pout - out;
+}
+
+/*
+ * Read the text of a field, without the quoting, as a decimal number with
+ * nothing but spaces around it. Returns FALSE if it is not one; that goes
+ * for what else strtod() reads, hex numbers, infinities and NaN, as well as
+ * for numbers too large for a double, so that numbers always compare.
+ */
+BOOL
+field_number(const uint8_t* text, size_t length, double* number)
+{
+    char buf[64];
+    char* end = NULL;
+
+    if (length >= sizeof(buf))
+        return FALSE;
+    length = field_unquote(text, length, (uint8_t*)buf);
+    buf[length] = 0;
+    if (strpbrk(buf, "xXiInN"))
+        return FALSE;
+    *number = strtod(buf, &end);
+    if (end == buf || !isfinite(*number))
+        return FALSE;
+    while (*end == ' ' || *end == '\t')
+        end++;
+    return !*end;
+}
+
+/* Whether the text of a field, without the quoting, is value */
+BOOL
+field_equals(const uint8_t* text, size_t length, const uint8_t* value,
+        size_t value_len)
+{
+    const uint8_t* start = text;
+    const uint8_t* end = text + length;
+    const uint8_t* value_end = value + value_len;
+    BOOL quoted = FALSE;
+
+    if (!memchr(text, '"', length))
+        return length == value_len && !memcmp(text, value, length);
+
+    while (text < end)
+    {
+        if (*text == '"' && (quoted || text == start)
+                && !(quoted && text + 1 < end && text[1] == '"'))
+        {
+            quoted = !quoted;
+            text++;
+            continue;
+        }
+        if (value == value_end || *value++ != *text)
+            return FALSE;
+        text += quoted && *text == '"' ? 2 : 1;
+    }
+    return value == value_end;
+}
+
+/*
+ * Find a column of the header row, split into list: by number, counting
+ * from 1, if column is all digits, else by name. Returns its index, or
+ * list->count if there is no such column.
+ */
+size_t
+field_list_find(const FieldList* list, const uint8_t* header,
+        const char* column, size_t length)
+{
+    size_t digits = 0;
+    size_t number = 0;
+    size_t i;
+
+    while (digits < length && column[digits] >= '0' && column[digits] <= '9')
+    {
+        if (number <= list->count)
+            number = number * 10 + (column[digits] - '0');
+        digits++;
+    }
+    if (length && digits == length)
+        return number && number <= list->count ? number - 1 : list->count;
+
+    for (i = 0; i < list->count; i++)
+        if (field_equals(header + list->fields[i].offset,
+                    list->fields[i].length, (const uint8_t*)column, length))
+            break;
+    return i;
+}
+
+/*
+ * Replace the fields by fields columns[0..count), in that order. Columns
+ * the record does not have become empty fields.
+ */
+void
+field_list_project(FieldList* list, const size_t* columns, size_t count)
+{
+    size_t parsed = list->count;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        Field* field = field_list_add(list, 0);
+
+        if (columns[i] < parsed)
+            *field = list->fields[columns[i]];
+    }
+    memmove(list->fields, list->fields + parsed, sizeof(Field) * count);
+    list->count = count;
+}
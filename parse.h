@@ -0,0 +1,177 @@
+/*
+ *    table - Command line utility to format and display CSV.
+ *    Copyright (C) 2020  Страхиња Радић
+ *
+ *    This program is free software: you can redistribute it and/or modify it
+ *    under the terms of the GNU General Public License as published by the Free
+ *    Software Foundation, either version 3 of the License, or (at your option)
+ *    any later version.
+ *
+ *    This program is distributed in the hope that it will be useful, but
+ *    WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *    or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *    for more details.
+ *
+ *    You should have received a copy of the GNU General Public License along
+ *    with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __PARSE_H
+#define __PARSE_H
+
+#include "defs.h"
+
+/* Field flags */
+#define FIELD_QUOTED 0x01 /* contains '"' characters or line breaks, which
+                             are shown as csv_step() says */
+#define FIELD_TAB    0x02 /* contains tab characters */
+#define FIELD_UTF8   0x04 /* known to be valid UTF-8 */
+
+/* Character classes of the CSV state machine */
+#define CSV_OTHER   0
+#define CSV_QUOTE   1
+#define CSV_DELIM   2
+#define CSV_CR      3
+#define CSV_LF      4
+#define CSV_CLASSES 5
+
+/* States of the CSV state machine */
+#define CSV_FIELD        0 /* at the start of a field */
+#define CSV_UNQUOTED     1
+#define CSV_QUOTED       2
+#define CSV_QUOTED_CR    3 /* quoted, after a carriage return */
+#define CSV_QUOTED_QUOTE 4 /* quoted, after a '"': closing or escaping */
+#define CSV_ERROR        5 /* malformed field (strict mode only) */
+#define CSV_STATES       6
+
+/* What to do with a character, given with every transition */
+#define CSV_SHOW  0 /* shown as it is */
+#define CSV_DROP  1 /* not shown: quoting and the LF of a quoted CRLF */
+#define CSV_SPACE 2 /* line break in a quoted field, shown as a space */
+#define CSV_SPLIT 3 /* delimiter, ends the field */
+
+/*
+ * How records are split and shown: the delimiter, the class of every ASCII
+ * character and the transition table of the chosen error mode. A transition
+ * is (next state << 2) | action. Fields wider than max_width are not
+ * measured to the end, as no column could show more of them. Records are
+ * checked to be UTF-8 when a field with bytes >= 0x80 is measured; with
+ * validate, every record is checked whole.
+ */
+typedef struct
+{
+    ucs4_t         delimiter;
+    BOOL           strict;
+    BOOL           validate;
+    size_t         max_width;
+    uint8_t        classes[128];
+    const uint8_t (*transitions)[CSV_CLASSES];
+} Dialect;
+
+/* Location of a single field within a record */
+typedef struct
+{
+    size_t offset; /* byte offset from the start of the record */
+    size_t length; /* length in bytes, quotes included */
+    size_t width;  /* display width in columns, quotes excluded; just
+                      over max_width of the dialect if it is wider */
+    UINT   flags;
+} Field;
+
+/*
+ * Growable array of fields, reused from record to record to avoid
+ * allocations on the hot path
+ */
+typedef struct
+{
+    Field* fields;
+    size_t count;
+    size_t size;
+    BOOL   malformed; /* a field broke the rules of a strict dialect */
+    BOOL   invalid;   /* the record was checked and is not valid UTF-8 */
+} FieldList;
+
+/*
+ * Decode the character at p, which is not ASCII, into *uch; returns its
+ * length in bytes. Text known to be valid UTF-8 is decoded without the
+ * checks; in other text, bytes that are not UTF-8 decode to U+FFFD.
+ */
+static inline int
+utf8_decode(const uint8_t* p, const uint8_t* end, BOOL valid, ucs4_t* uch)
+{
+    if (!valid)
+        return u8_mbtouc(uch, p, end - p);
+    if (*p < 0xE0)
+    {
+        *uch = (p[0] & 0x1F) << 6 | (p[1] & 0x3F);
+        return 2;
+    }
+    if (*p < 0xF0)
+    {
+        *uch = (p[0] & 0x0F) << 12 | (p[1] & 0x3F) << 6 | (p[2] & 0x3F);
+        return 3;
+    }
+    *uch = (p[0] & 0x07) << 18 | (p[1] & 0x3F) << 12 | (p[2] & 0x3F) << 6
+        | (p[3] & 0x3F);
+    return 4;
+}
+
+/*
+ * Whether the character of ch_len bytes at p, decoded to uch by
+ * utf8_decode(), stands for bytes that are not UTF-8
+ */
+static inline BOOL
+utf8_invalid(const uint8_t* p, int ch_len, ucs4_t uch)
+{
+    return uch == 0xFFFD && (ch_len != 3 || *p != 0xEF);
+}
+
+/*
+ * Class of the character at p, which is decoded into *uch as by
+ * utf8_decode(); returns its length in bytes
+ */
+static inline int
+csv_class(const Dialect* dialect, const uint8_t* p, const uint8_t* end,
+        BOOL valid, ucs4_t* uch, UINT* class)
+{
+    int ch_len;
+
+    if (*p < 0x80)
+    {
+        *uch = *p;
+        *class = dialect->classes[*p];
+        return 1;
+    }
+    ch_len = utf8_decode(p, end, valid, uch);
+    *class = *uch == dialect->delimiter ? CSV_DELIM : CSV_OTHER;
+    return ch_len;
+}
+
+/* Move *state on by a character of class; returns what to do with it */
+static inline UINT
+csv_step(const Dialect* dialect, UINT* state, UINT class)
+{
+    uint8_t transition = dialect->transitions[*state][class];
+
+    *state = transition >> 2;
+    return transition & 3;
+}
+
+void field_list_init(FieldList* list);
+void field_list_free(FieldList* list);
+void dialect_init(Dialect* dialect, ucs4_t delimiter, BOOL strict);
+size_t parse_record(const uint8_t* record, size_t length,
+        const Dialect* dialect, size_t max_fields, const uint8_t* measure,
+        FieldList* list);
+size_t field_list_find(const FieldList* list, const uint8_t* header,
+        const char* column, size_t length);
+void field_list_project(FieldList* list, const size_t* columns,
+        size_t count);
+size_t field_unquote(const uint8_t* text, size_t length, uint8_t* out);
+BOOL field_number(const uint8_t* text, size_t length, double* number);
+BOOL field_equals(const uint8_t* text, size_t length, const uint8_t* value,
+        size_t value_len);
+
+#endif
+
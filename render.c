@@ -0,0 +1,1369 @@
+/*
+ *    table - Command line utility to format and display CSV.
+ *    Copyright (C) 2020  Страхиња Радић
+ *
+ *    This program is free software: you can redistribute it and/or modify it
+ *    under the terms of the GNU General Public License as published by the Free
+ *    Software Foundation, either version 3 of the License, or (at your option)
+ *    any later version.
+ *
+ *    This program is distributed in the hope that it will be useful, but
+ *    WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *    or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *    for more details.
+ *
+ *    You should have received a copy of the GNU General Public License along
+ *    with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <pthread.h>
+#include "parallel.h"
+#include "render.h"
+#include "scan.h"
+#include "width.h"
+
+/* The scanner is picked once for all tables */
+static pthread_once_t scan_once = PTHREAD_ONCE_INIT;
+
+/* Taken by -j workers to add the --summary totals of their chunks */
+static pthread_mutex_t summary_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Print a message for the user on stderr; returns code */
+int
+table_report(int code, uint8_t* fmt, ...)
+{
+    uint8_t    buf[BUFSIZE];
+    va_list args;
+    va_start(args, fmt);
+    u8_vsnprintf(buf, sizeof(buf), (const char*)fmt, args);
+    va_end(args);
+    fprintf(stderr, "%s: %s\n", PROGRAMNAME, buf);
+    return code;
+}
+
+/*
+ * Stop rendering with an error, keeping the message for table_error(). The
+ * first error wins when -j workers fail at the same time.
+ */
+static void
+table_fail(Table* t, int code, const char* fmt, ...)
+{
+    int expected = 0;
+    va_list args;
+
+    if (!__atomic_compare_exchange_n(&t->error, &expected, code, FALSE,
+                __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+        return;
+    va_start(args, fmt);
+    u8_vsnprintf(t->message, sizeof(t->message), fmt, args);
+    va_end(args);
+}
+
+static UINT
+round_div(UINT a, UINT b)
+{
+    return (a + (b/2)) / b;
+}
+
+static ULONG
+column_width(const Table* t, size_t table_column)
+{
+    return t->format ? *(t->format+table_column) : t->format_value;
+}
+
+/* Copy the pending run of visible bytes [*span, end) to the output */
+static inline void
+flush_span(Output* out, const uint8_t** span, const uint8_t* end)
+{
+    if (*span)
+    {
+        output_bytes(out, *span, end - *span);
+        *span = NULL;
+    }
+}
+
+/*
+ * render_row() for the header, bold unless -n, and the kernels for data
+ * rows, which are never bold: one for each choice of tab expansion and
+ * column widths, all of a width or set by --format, picked by layout()
+ */
+#define KERNEL(name) name
+#define KERNEL_TABS (t->options.expand_tabs && !t->options.border_mode)
+#define KERNEL_WIDTH(t, column) column_width(t, column)
+#define KERNEL_BOLD (t->options.bold_header)
+#include "kernel.h"
+
+#define KERNEL(name) name##_even
+#define KERNEL_TABS FALSE
+#define KERNEL_WIDTH(t, column) ((t)->format_value)
+#define KERNEL_BOLD FALSE
+#include "kernel.h"
+
+#define KERNEL(name) name##_formatted
+#define KERNEL_TABS FALSE
+#define KERNEL_WIDTH(t, column) ((t)->format[column])
+#define KERNEL_BOLD FALSE
+#include "kernel.h"
+
+#define KERNEL(name) name##_even_tabs
+#define KERNEL_TABS TRUE
+#define KERNEL_WIDTH(t, column) ((t)->format_value)
+#define KERNEL_BOLD FALSE
+#include "kernel.h"
+
+#define KERNEL(name) name##_formatted_tabs
+#define KERNEL_TABS TRUE
+#define KERNEL_WIDTH(t, column) ((t)->format[column])
+#define KERNEL_BOLD FALSE
+#include "kernel.h"
+
+/* Kernels by tab expansion, then by whether columns follow a format */
+static const RowKernel row_kernels[2][2] =
+{
+    { render_row_even, render_row_formatted },
+    { render_row_even_tabs, render_row_formatted_tabs }
+};
+
+/* What split_record() made of a record */
+enum
+{
+    SPLIT_FAILED,   /* malformed, or a column of the header is missing */
+    SPLIT_KEPT,
+    SPLIT_FILTERED  /* left out by --where */
+};
+
+/* Read the next non-empty record of input */
+BOOL
+table_next_record(Input* in, const uint8_t** line, size_t* line_len)
+{
+    STATS_PHASE(phase, STATS_PARSE)
+    while (input_next_record(in, line, line_len))
+        if (*line_len)
+        {
+            STATS_RESUME(phase)
+            return TRUE;
+        }
+    STATS_RESUME(phase)
+    return FALSE;
+}
+
+/* Parse a 1-based column number; 0 if it is not one */
+static size_t
+select_number(const char* item, size_t length)
+{
+    size_t number = 0;
+
+    for (size_t i = 0; i < length; i++)
+    {
+        if (item[i] < '0' || item[i] > '9'
+                || number > (SIZE_MAX - 9) / 10)
+            return 0;
+        number = number * 10 + (item[i] - '0');
+    }
+    return number;
+}
+
+/*
+ * Turn the --select list into source columns, now that the header (split
+ * into all of its fields) tells names and the number of columns. Items are
+ * column numbers, ranges N-M, N- or -M, or header names, separated by
+ * commas.
+ */
+static BOOL
+resolve_select(Table* t, const uint8_t* header, const FieldList* list)
+{
+    const char* item = t->select_spec;
+    size_t size = 0;
+
+    while (*item)
+    {
+        const char* comma = strchr(item, ',');
+        size_t length = comma ? (size_t)(comma - item) : strlen(item);
+        const char* dash = memchr(item, '-', length);
+        size_t first = 0;
+        size_t through = 0;
+        size_t i;
+
+        if (!length)
+        {
+            table_fail(t, EINVAL, "Invalid column selection: %s",
+                    t->select_spec);
+            return FALSE;
+        }
+
+        if ((first = select_number(item, length)))
+            through = first;
+        else if (dash)
+        {
+            size_t tail = item + length - dash - 1;
+
+            first = dash == item ? 1 : select_number(item, dash - item);
+            through = tail ? select_number(dash + 1, tail) : list->count;
+        }
+
+        /* Anything else names a column */
+        if (!first || !through)
+            first = through = field_list_find(list, header, item, length) + 1;
+        if (first > through || through > list->count)
+        {
+            table_fail(t, EINVAL, "No such column: %.*s", (int)length, item);
+            return FALSE;
+        }
+
+        for (i = first - 1; i < through; i++)
+        {
+            if (t->select_count == size)
+            {
+                size = size ? size * 2 : 8;
+                REALLOCARRAY(t->select, size_t, size)
+            }
+            t->select[t->select_count++] = i;
+        }
+        item += length + (comma != NULL);
+    }
+    if (!t->select_count)
+    {
+        table_fail(t, EINVAL, "Invalid column selection: %s",
+                t->select_spec);
+        return FALSE;
+    }
+    free(t->select_spec);
+    t->select_spec = NULL;
+    return TRUE;
+}
+
+/* Find the columns named by --select and --where in the header row */
+static BOOL
+resolve_columns(Table* t, const uint8_t* header, const FieldList* list)
+{
+    const char* missing = NULL;
+    size_t last = t->where.last_field;
+
+    t->resolved = TRUE;
+    if (t->select_spec && !resolve_select(t, header, list))
+        return FALSE;
+    if (!where_resolve(&t->where, header, list, &missing)
+            || (t->sorter.key_count
+                && !sort_resolve(&t->sorter, header, list, &missing)))
+    {
+        table_fail(t, EINVAL, "No such column: %s", missing);
+        return FALSE;
+    }
+    t->source_fields = list->count;
+    if (!t->select)
+        return TRUE;
+
+    /* Split records one field past the last column used, which then takes
+     * the rest unread; if that is the last column, it takes the rest */
+    for (size_t i = 0; i < t->select_count; i++)
+        if (t->select[i] > last)
+            last = t->select[i];
+    t->source_fields = last + 2 < list->count ? last + 2 : list->count;
+    CALLOC(t->measure, uint8_t, t->source_fields)
+    for (size_t i = 0; i < t->select_count; i++)
+        t->measure[t->select[i]] = TRUE;
+    return TRUE;
+}
+
+/*
+ * Split a record into fields. The header row determines the number of
+ * columns; the last column of every later row takes whatever is left of
+ * it. With --select, only the columns shown are measured, and the list is
+ * left holding just them. Rows are checked against --where first.
+ */
+static UINT
+split_record(Table* t, const uint8_t* record, size_t length, BOOL header,
+        FieldList* list)
+{
+    size_t max_fields = t->source_fields;
+
+    if (header)
+        max_fields = t->options.border_mode ? 1 : SIZE_MAX;
+
+    STATS_PHASE(phase, STATS_PARSE)
+    parse_record(record, length, &t->dialect, max_fields, t->measure, list);
+    STATS_RESUME(phase)
+    if (!t->sampling)
+    {
+        STATS_ADD(records, 1)
+        STATS_ADD(fields, list->count)
+        STATS_MAX(longest_line, length)
+    }
+    if (list->malformed)
+    {
+        const uint8_t* eol = memchr(record, '\n', length);
+        int shown = eol ? eol - record : (int)length;
+
+        table_fail(t, EILSEQ, "Malformed record: %.*s", shown, record);
+        return SPLIT_FAILED;
+    }
+    if (list->invalid && t->options.invalid == TABLE_INVALID_ERROR)
+    {
+        const uint8_t* eol = memchr(record, '\n', length);
+        int shown = eol ? eol - record : (int)length;
+
+        table_fail(t, EILSEQ, "Invalid UTF-8 in record: %.*s", shown, record);
+        return SPLIT_FAILED;
+    }
+
+    if (header && !t->resolved && !resolve_columns(t, record, list))
+        return SPLIT_FAILED;
+    if (!header && t->where.count && !where_match(&t->where, record, list))
+        return SPLIT_FILTERED;
+    if (t->select)
+        field_list_project(list, t->select, t->select_count);
+    return SPLIT_KEPT;
+}
+
+/*
+ * Measure the widest field of every column in the header and the rows
+ * following it, up to sample_rows rows or sample_bytes bytes (everything
+ * with exact_fit), then rewind the input. The widths, indexed by column,
+ * are left in content_widths (NULL if the input is empty). Returns FALSE
+ * if pushed input ran out before that, to be tried again with more.
+ */
+static BOOL
+sample_widths(Table* t, Input* in)
+{
+    const TableOptions* options = &t->options;
+    FieldList* list = &t->fields;
+    const uint8_t* line = NULL;
+    size_t line_len = 0;
+    size_t* widths = NULL;
+    size_t columns = 0;
+    size_t rows = 0;
+    BOOL following = in->follow;
+    BOOL limited = FALSE;
+
+    /* When following, only measure what has been written so far */
+    in->follow = FALSE;
+    t->sampling = TRUE;
+    input_mark(in);
+    while (!(limited = !options->exact_fit && (rows > options->sample_rows
+                    || input_since_mark(in) >= options->sample_bytes))
+            && table_next_record(in, &line, &line_len))
+    {
+        UINT split = split_record(t, line, line_len, rows == 0, list);
+
+        if (split == SPLIT_FAILED)
+            break;
+        if (split == SPLIT_FILTERED)
+            continue;
+        if (rows == 0)
+        {
+            columns = list->count;
+            CALLOC(widths, size_t, columns)
+        }
+        for (size_t i = 0; i < list->count; i++)
+            if (list->fields[i].width > widths[i])
+                widths[i] = list->fields[i].width;
+        rows++;
+    }
+    input_rewind(in);
+    t->sampling = FALSE;
+    if (following)
+    {
+        in->follow = TRUE;
+        in->eof = FALSE;
+    }
+
+    if (!limited && in->pushed && !in->eof && !t->error)
+    {
+        free(widths);
+        return FALSE;
+    }
+    t->content_widths = widths;
+    t->sampled = TRUE;
+    return TRUE;
+}
+
+/*
+ * Set column widths from the measured content widths. Columns narrower
+ * than an equal share of what is left get exactly what they need; the
+ * space that remains is split equally between the wider ones.
+ */
+static void
+fit_columns(Table* t, const size_t* widths, size_t available)
+{
+    BOOL* fixed = NULL;
+    size_t open = t->table_columns;
+    BOOL progress = TRUE;
+
+    t->format_size = t->table_columns + 1;
+    CALLOC(t->format, ULONG, t->format_size)
+    CALLOC(fixed, BOOL, t->table_columns)
+
+    while (open && progress)
+    {
+        size_t share = available / open;
+
+        progress = FALSE;
+        for (size_t i = 0; i < t->table_columns; i++)
+        {
+            if (!fixed[i] && widths[i] <= share)
+            {
+                t->format[i] = widths[i] ? widths[i] : 1;
+                if (t->format[i] > available)
+                    t->format[i] = available;
+                available -= t->format[i];
+                fixed[i] = TRUE;
+                open--;
+                progress = TRUE;
+            }
+        }
+    }
+
+    for (size_t i = 0; i < t->table_columns && open; i++)
+    {
+        if (!fixed[i])
+        {
+            t->format[i] = (available + open - 1) / open;
+            available -= t->format[i];
+            open--;
+        }
+    }
+
+    free(fixed);
+}
+
+/* Fix the number and widths of the columns from the header row */
+static void
+layout(Table* t, const uint8_t* header, size_t header_len)
+{
+    size_t available;
+
+    t->table_columns = t->fields.count;
+
+    t->header_len = header_len;
+    CALLOC(t->header, uint8_t, t->header_len)
+    memcpy(t->header, header, t->header_len);
+
+    /* Sanity check */
+    if (t->rune_columns < t->table_columns+2)
+        t->rune_columns = t->table_columns+2;
+    available = t->rune_columns-t->table_columns-2;
+
+    /* Columns left out of the format get no width */
+    if (t->format && t->format_size < t->table_columns + 1)
+    {
+        REALLOCARRAY(t->format, ULONG, (t->table_columns + 1))
+        memset(t->format + t->format_size, 0, sizeof(ULONG)
+                * (t->table_columns + 1 - t->format_size));
+        t->format_size = t->table_columns + 1;
+        t->options.format = t->format;
+    }
+
+    if (t->content_widths)
+        fit_columns(t, t->content_widths, available);
+    else if (t->format && !t->options.border_mode)
+    {
+        ULONG* pformat = t->format;
+        ULONG format_sum = 0;
+        while (*pformat)
+            format_sum += *pformat++;
+        pformat = t->format;
+        while (*pformat && format_sum)
+        {
+            *pformat = round_div(available * (*pformat), format_sum);
+            pformat++;
+        }
+    }
+    else
+        t->format_value = available / t->table_columns;
+
+    t->row_kernel = row_kernels[t->options.expand_tabs
+        && !t->options.border_mode][t->format != NULL];
+
+    if (t->options.summary)
+        summary_init(&t->summary, t->table_columns);
+}
+
+/* Lay out a horizontal line of the table once, to be copied as it is */
+static void
+build_rule(Table* t, UINT rule, const uint8_t* left,
+        const uint8_t* horizontal, const uint8_t* junction,
+        const uint8_t* right)
+{
+    size_t horizontal_len = strlen((const char*)horizontal);
+    Output line;
+
+    output_init(&line, -1);
+    output_string(&line, left);
+    for (size_t i = 0; i < t->table_columns; i++)
+    {
+        ULONG width = column_width(t, i);
+
+        output_reserve(&line, width * horizontal_len);
+        while (width--)
+            output_bytes(&line, horizontal, horizontal_len);
+        output_string(&line, i == t->table_columns-1 ? right : junction);
+    }
+    output_newline(&line);
+
+    t->rules[rule] = line.buffer;
+    t->rule_len[rule] = line.length;
+}
+
+/* Build the borders and the row separator for the layout */
+static void
+build_rules(Table* t)
+{
+    const uint8_t* const* symbols = table_symbols[t->options.symbols];
+    const uint8_t* const* inner = table_inner_symbols[t->options.inner_symbols];
+    const uint8_t* const* separator =
+        table_separator_symbols[t->options.inner_symbols];
+
+    build_rule(t, RULE_TOP, symbols[0], symbols[1], inner[0], symbols[2]);
+    build_rule(t, RULE_SEPARATOR, separator[0], separator[1], separator[2],
+            separator[3]);
+    build_rule(t, RULE_BOTTOM, symbols[6], symbols[7], inner[2], symbols[8]);
+}
+
+static void
+render_rule(const Table* t, Output* out, UINT rule)
+{
+    output_line(out, t->rules[rule], t->rule_len[rule]);
+}
+
+/* Render a row of data, after the header again if --repeat-header says so */
+static void
+render_data_row(Table* t, const uint8_t* record, size_t length)
+{
+    const TableOptions* options = &t->options;
+
+    if (options->repeat_header && t->lineno > 1
+            && (t->lineno-1) % options->repeat_header == 0)
+    {
+        if (options->row_separators)
+            render_rule(t, &t->out, RULE_SEPARATOR);
+        output_line(&t->out, t->header_line, t->header_line_len);
+    }
+    t->row_kernel(t, &t->out, record, &t->fields);
+    if (t->summary.columns)
+        summary_add(&t->summary, record, length, &t->fields);
+    t->output_lines++;
+    t->lineno++;
+}
+
+/* Render the header row, keeping a copy for --repeat-header */
+static void
+render_header(Table* t, const uint8_t* record)
+{
+    Output line;
+
+    output_init(&line, -1);
+    render_row(t, &line, record, &t->fields);
+    t->header_line = line.buffer;
+    t->header_line_len = line.length;
+    output_line(&t->out, t->header_line, t->header_line_len);
+}
+
+/*
+ * Skip to data row start (counted from 1, header excluded). With a row
+ * index, jump to the closest indexed row first.
+ */
+static void
+skip_rows(const Table* t, Input* in, size_t start)
+{
+    const uint8_t* line = NULL;
+    size_t line_len = 0;
+    size_t skip = start - 1;
+
+    if (t->index && t->index->count)
+    {
+        size_t k = skip / t->index->stride;
+        if (k >= t->index->count)
+            k = t->index->count - 1;
+        in->position = t->index->offsets[k];
+        skip -= k * t->index->stride;
+    }
+
+    while (skip-- && table_next_record(in, &line, &line_len))
+        ;
+}
+
+/* Whether max_bytes or max_time has been used up */
+static BOOL
+over_budget(const Table* t, Input* in)
+{
+    return (t->options.max_bytes && input_consumed(in) >= t->options.max_bytes)
+        || input_expired(in);
+}
+
+/*
+ * Start of the line lines lines back from the end of data, a line break at
+ * its very end aside, or if there are fewer after first, of the first line
+ * at or after it, which sets *reached. Only from is known to start a line
+ * without a line break before it.
+ */
+static size_t
+line_back(const uint8_t* data, size_t from, size_t first, size_t length,
+        size_t lines, BOOL* reached)
+{
+    size_t start = length;
+    const uint8_t* eol;
+
+    *reached = FALSE;
+    if (start > first && data[start-1] == '\n')
+        start--;
+    for (; start > first; start--)
+        if (data[start-1] == '\n' && !--lines)
+            return start;
+
+    *reached = TRUE;
+    if (start == from || data[start-1] == '\n')
+        return start;
+    eol = memchr(data + start, '\n', length - start);
+    return eol ? (size_t)(eol - data) + 1 : length;
+}
+
+/*
+ * Read the lines of data from start on twice over: taking start for the
+ * start of a row, and for a point within a quoted field (unless certain
+ * says it is known to start a row). Sets rows[0] to the number of rows of
+ * the first reading, and rows[1] to the number of those after a line break
+ * where both readings agree, which makes them certain, or to SIZE_MAX if
+ * they never do. Returns the start of row wanted (from 0) of those counted
+ * in rows[by], or length.
+ */
+static size_t
+tail_rows(const uint8_t* data, size_t start, size_t length, ucs4_t delimiter,
+        BOOL certain, UINT by, size_t wanted, size_t rows[2])
+{
+    UINT row = SCAN_FIELD;
+    UINT other = certain ? SCAN_FIELD : SCAN_QUOTED;
+    size_t position = start;
+
+    rows[0] = 0;
+    rows[1] = row == other ? 0 : SIZE_MAX;
+    while (position < length)
+    {
+        const uint8_t* eol = memchr(data + position, '\n', length - position);
+        size_t end = eol ? (size_t)(eol - data) : length;
+
+        if (row != SCAN_QUOTED && end > position
+                && !(end - position == 1 && data[position] == '\r'))
+        {
+            if (rows[by] == wanted)
+                return position;
+            rows[0]++;
+            if (rows[1] != SIZE_MAX)
+                rows[1]++;
+        }
+
+        /* A line break outside of quotes starts a row */
+        row = scan_quoting(data + position, end - position, delimiter, row)
+            == SCAN_QUOTED ? SCAN_QUOTED : SCAN_FIELD;
+        other = scan_quoting(data + position, end - position, delimiter,
+                other) == SCAN_QUOTED ? SCAN_QUOTED : SCAN_FIELD;
+        if (rows[1] == SIZE_MAX && row == other)
+            rows[1] = 0;
+        position = end + 1;
+    }
+    return length;
+}
+
+/*
+ * Start of the last count rows of data, looking backwards from its end but
+ * not before from and not at more than max_bytes bytes (if set). A row
+ * crossing that limit is left out. Whether a line break ends a row depends
+ * on the quoting before it, which cannot be told from behind, so the lines
+ * after some line start are read forward by tail_rows(). If its readings
+ * never agree, the input is taken not to end within a quoted field; if
+ * they do, the line start is moved back until count certain rows follow.
+ */
+static size_t
+tail_offset(const uint8_t* data, size_t from, size_t length, size_t count,
+        size_t max_bytes, ucs4_t delimiter)
+{
+    size_t limit = max_bytes && length - from > max_bytes
+        ? length - max_bytes : from;
+    size_t lines = count < SIZE_MAX / 2 ? count + 1 : SIZE_MAX;
+    size_t rows[2];
+
+    if (!count)
+        return length;
+    for (;;)
+    {
+        BOOL reached;
+        size_t start = line_back(data, from, limit, length, lines, &reached);
+        BOOL certain = start == from;
+        UINT by;
+
+        tail_rows(data, start, length, delimiter, certain, 0, SIZE_MAX, rows);
+        by = rows[1] != SIZE_MAX;
+        if (rows[by] >= count || reached)
+            return tail_rows(data, start, length, delimiter, certain, by,
+                    rows[by] > count ? rows[by] - count : 0, rows);
+        lines = lines < SIZE_MAX / 2 ? lines * 2 : SIZE_MAX;
+    }
+}
+
+/* Row shown in place of the rows left out by a preview */
+static void
+render_elision(const Table* t, Output* out)
+{
+    static const uint8_t ellipsis[] = "...";
+    FieldList list;
+
+    field_list_init(&list);
+    for (size_t i = 0; i < t->table_columns; i++)
+    {
+        if (list.count == list.size)
+        {
+            list.size *= 2;
+            REALLOCARRAY(list.fields, Field, list.size)
+        }
+        list.fields[list.count].offset = 0;
+        list.fields[list.count].length = strlen((const char*)ellipsis);
+        list.fields[list.count].width = strlen((const char*)ellipsis);
+        list.fields[list.count].flags = 0;
+        list.count++;
+    }
+    t->row_kernel(t, out, ellipsis, &list);
+    field_list_free(&list);
+}
+
+/* The --summary footer, set off from the rows above it */
+static void
+render_summary(Table* t)
+{
+    Output text;
+    FieldList list;
+
+    if (!t->options.row_separators)
+    {
+        render_rule(t, &t->out, RULE_SEPARATOR);
+        t->output_lines++;
+    }
+
+    output_init(&text, -1);
+    list.count = list.size = t->table_columns;
+    list.malformed = list.invalid = FALSE;
+    CALLOC(list.fields, Field, list.size)
+    for (UINT line = 0; line < SUMMARY_LINES; line++)
+    {
+        text.length = 0;
+        for (size_t i = 0; i < t->table_columns; i++)
+        {
+            uint8_t cell[SUMMARY_CELLSIZE];
+            size_t length = summary_cell(&t->summary, line, i, cell);
+
+            list.fields[i].offset = text.length;
+            list.fields[i].length = length;
+            list.fields[i].width = length;
+            list.fields[i].flags = FIELD_UTF8;
+            output_bytes(&text, cell, length);
+        }
+        t->row_kernel(t, &t->out, text.buffer, &list);
+        t->output_lines++;
+    }
+    field_list_free(&list);
+    output_free(&text);
+}
+
+/*
+ * Finish a preview of a mapped file: show that rows were left out, if they
+ * were, and render the last tail_rows rows, found by searching backwards
+ * from the end of the file so the rows in between are never read
+ */
+static void
+render_tail_mapped(Table* t, Input* in)
+{
+    const uint8_t* line = NULL;
+    size_t line_len = 0;
+    size_t tail = tail_offset(in->data, in->position, in->length,
+            t->options.tail_rows, t->options.max_bytes,
+            t->dialect.delimiter);
+    BOOL skipped;
+
+    input_mark(in);
+    skipped = table_next_record(in, &line, &line_len)
+        && (size_t)(line - in->data) < tail;
+    input_rewind(in);
+    if (skipped)
+        render_elision(t, &t->out);
+    if (tail > in->position)
+        in->position = tail;
+    while (table_next_record(in, &line, &line_len))
+    {
+        UINT split = split_record(t, line, line_len, FALSE, &t->fields);
+
+        if (split == SPLIT_FAILED)
+            break;
+        if (split != SPLIT_KEPT)
+            continue;
+        t->row_kernel(t, &t->out, line, &t->fields);
+        if (t->summary.columns)
+            summary_add(&t->summary, line, line_len, &t->fields);
+    }
+    t->done = TRUE;
+}
+
+/*
+ * Finish a preview of a stream: read through it within the budget, keeping
+ * only the last tail_rows rows, then render them. Pushed input may run out
+ * before its end, in which case this picks up again with more.
+ */
+static void
+render_tail_stream(Table* t, Input* in)
+{
+    size_t tail_rows = t->options.tail_rows;
+    const uint8_t* line = NULL;
+    size_t line_len = 0;
+    BOOL stopped = FALSE;
+    size_t kept;
+
+    if (tail_rows && !t->ring)
+    {
+        CALLOC(t->ring, uint8_t*, tail_rows)
+        CALLOC(t->ring_len, size_t, tail_rows)
+    }
+    while (!over_budget(t, in) && table_next_record(in, &line, &line_len))
+    {
+        UINT split = t->where.count
+            ? split_record(t, line, line_len, FALSE, &t->fields) : SPLIT_KEPT;
+
+        if (split == SPLIT_FAILED)
+            break;
+        if (split == SPLIT_FILTERED)
+            continue;
+        if (!tail_rows)
+        {
+            t->skipped = stopped = TRUE;
+            break;
+        }
+        if (t->kept == tail_rows)
+        {
+            free(t->ring[t->next]);
+            t->skipped = TRUE;
+        }
+        else
+            t->kept++;
+        CALLOC(t->ring[t->next], uint8_t, line_len)
+        memcpy(t->ring[t->next], line, line_len);
+        t->ring_len[t->next] = line_len;
+        t->next = (t->next + 1) % tail_rows;
+    }
+    if (in->pushed && !in->eof && !stopped && !over_budget(t, in)
+            && !t->error)
+        return;
+
+    kept = t->kept;
+    if (t->skipped && kept)
+        render_elision(t, &t->out);
+    for (size_t i = 0; i < kept; i++)
+    {
+        size_t k = (t->next + tail_rows - kept + i) % tail_rows;
+        if (!t->error
+                && split_record(t, t->ring[k], t->ring_len[k], FALSE,
+                    &t->fields) == SPLIT_KEPT)
+        {
+            t->row_kernel(t, &t->out, t->ring[k], &t->fields);
+            if (t->summary.columns)
+                summary_add(&t->summary, t->ring[k], t->ring_len[k],
+                        &t->fields);
+        }
+        free(t->ring[k]);
+    }
+    t->kept = 0;
+
+    /* Reading stopped short of the end of the input */
+    if ((t->skipped && !kept) || (over_budget(t, in)
+                && (!in->eof || in->position < in->length)))
+        render_elision(t, &t->out);
+    t->done = TRUE;
+}
+
+/*
+ * Read the rows passing --where, within the budget, and render them in the
+ * order of --sort, taking --rows, --head and --tail from that order. Pushed
+ * input may run out before its end, in which case this picks up again with
+ * more.
+ */
+static void
+render_sorted(Table* t, Input* in)
+{
+    const TableOptions* options = &t->options;
+    Sorter* sorter = &t->sorter;
+    const uint8_t* line = NULL;
+    size_t line_len = 0;
+    size_t first;
+    size_t count;
+    size_t head;
+    size_t tail;
+    BOOL stopped;
+    int code = 0;
+
+    while (!code && !over_budget(t, in)
+            && table_next_record(in, &line, &line_len))
+    {
+        UINT split = t->where.count
+            ? split_record(t, line, line_len, FALSE, &t->fields) : SPLIT_KEPT;
+
+        if (split == SPLIT_FAILED)
+            return;
+        if (split == SPLIT_FILTERED)
+            continue;
+        STATS_PHASE(phase, STATS_SORT)
+        code = sort_add(sorter, line, line_len, !in->mapped);
+        STATS_RESUME(phase)
+    }
+    if (!code && in->pushed && !in->eof && !over_budget(t, in))
+        return;
+    stopped = over_budget(t, in) && (!in->eof || in->position < in->length);
+
+    STATS_PHASE(phase, STATS_SORT)
+    if (!code)
+        code = sort_finish(sorter);
+    STATS_RESUME(phase)
+
+    /* Rows shown: from rows_start on, rows_count of them, of which the
+     * first head_rows and the last tail_rows */
+    first = options->rows_start > 1 ? options->rows_start - 1 : 0;
+    count = first < sorter->total ? sorter->total - first : 0;
+    if (count > options->rows_count)
+        count = options->rows_count;
+    head = options->head_rows < count ? options->head_rows : count;
+    tail = options->tail_rows < count - head ? options->tail_rows
+        : count - head;
+
+    for (size_t i = 0; !code && !t->error; i++)
+    {
+        STATS_PHASE(phase, STATS_SORT)
+        code = sort_next(sorter, &line, &line_len);
+        STATS_RESUME(phase)
+        if (code || !line || i >= first + count)
+            break;
+        if (i < first)
+            continue;
+        if (i - first == head && head + tail < count)
+            render_elision(t, &t->out);
+        if ((i - first < head || i - first >= count - tail)
+                && split_record(t, line, line_len, FALSE, &t->fields)
+                    == SPLIT_KEPT)
+            render_data_row(t, line, line_len);
+    }
+    if (code)
+        table_fail(t, code, "Cannot sort: %s", strerror(code));
+    else if (stopped)
+        render_elision(t, &t->out);
+    t->done = TRUE;
+}
+
+/* Render the rows of a chunk of input; run by the -j worker threads */
+static void
+render_chunk(void* context, const uint8_t* data, size_t length, Output* out)
+{
+    Table* t = context;
+    const uint8_t* line = NULL;
+    size_t line_len = 0;
+    FieldList fields;
+    Summary summary;
+    Input chunk;
+
+    input_from_memory(&chunk, data, length);
+    chunk.delimiter = t->dialect.delimiter;
+    field_list_init(&fields);
+    memset(&summary, 0, sizeof(Summary));
+    if (t->summary.columns)
+        summary_init(&summary, t->summary.count);
+
+    while (table_next_record(&chunk, &line, &line_len))
+    {
+        UINT split = split_record(t, line, line_len, FALSE, &fields);
+
+        if (split == SPLIT_FAILED)
+            break;
+        if (split != SPLIT_KEPT)
+            continue;
+        t->row_kernel(t, out, line, &fields);
+        if (summary.columns)
+            summary_add(&summary, line, line_len, &fields);
+    }
+
+    if (summary.columns)
+    {
+        pthread_mutex_lock(&summary_lock);
+        summary_merge(&t->summary, &summary);
+        pthread_mutex_unlock(&summary_lock);
+        summary_free(&summary);
+    }
+    field_list_free(&fields);
+}
+
+/*
+ * Render the records of in for as long as it has them: up to its end, or
+ * for pushed input up to the last complete record. Returns 0, or the error
+ * that stopped rendering.
+ */
+int
+table_render_input(Table* t, Input* in)
+{
+    const TableOptions* options = &t->options;
+    const uint8_t* line = NULL;
+    size_t line_len = 0;
+    UINT split;
+
+    /* Unless the whole text of fields is looked at, a stream need not keep
+     * more of a field than fits the table */
+    if (!t->where.count && !t->sorter.key_count && !options->summary
+            && !t->dialect.strict && !t->dialect.validate)
+        in->max_columns = t->dialect.max_width;
+
+    while (!t->done && !t->error && !t->out.error)
+    {
+        if (t->tailing)
+        {
+            render_tail_stream(t, in);
+            break;
+        }
+        if (t->sorting)
+        {
+            render_sorted(t, in);
+            break;
+        }
+
+        if (options->auto_fit && !options->format && !t->sampled
+                && !sample_widths(t, in))
+            break;
+
+        if (!table_next_record(in, &line, &line_len))
+            break;
+
+        /* A followed log that was rotated or truncated starts over with
+         * the same header, which is already on the screen */
+        if (in->generation != t->generation)
+        {
+            t->generation = in->generation;
+            if (line_len == t->header_len
+                    && !memcmp(line, t->header, t->header_len))
+                continue;
+        }
+
+        split = split_record(t, line, line_len, t->lineno == 0, &t->fields);
+        if (split == SPLIT_FAILED)
+            break;
+
+        /* Rows left out by --where count only against the budget */
+        if (split == SPLIT_FILTERED)
+        {
+            if (t->preview && over_budget(t, in))
+                t->tailing = TRUE;
+            continue;
+        }
+
+        /* Top border and header */
+        if (t->lineno == 0)
+        {
+            layout(t, line, line_len);
+            build_rules(t);
+            render_rule(t, &t->out, RULE_TOP);
+            t->output_lines++;
+            render_header(t, line);
+            t->output_lines++;
+            t->lineno++;
+        }
+        /* Inner rows */
+        else
+            render_data_row(t, line, line_len);
+
+        if (t->lineno > options->rows_count)
+        {
+            t->done = TRUE;
+            break;
+        }
+
+        /* The rows are rendered once all of them are read and sorted */
+        if (t->lineno == 1 && t->sorter.key_count)
+        {
+            t->sorting = TRUE;
+            continue;
+        }
+        if (t->lineno == 1 && options->rows_start > 1)
+            skip_rows(t, in, options->rows_start);
+
+        if (t->preview
+                && (t->lineno > options->head_rows || over_budget(t, in)))
+        {
+            /* The rows found from the end would still have to pass
+             * --where, so with it the rest is read through */
+            if (in->mapped && !t->where.count)
+                render_tail_mapped(t, in);
+            else
+                t->tailing = TRUE;
+            continue;
+        }
+
+        /* The layout is fixed now, so the rest of a mapped file can be
+         * rendered in parallel */
+        if (options->jobs != 1 && in->mapped && !options->repeat_header
+                && !options->rows_start && options->rows_count == SIZE_MAX
+                && !t->preview)
+        {
+            render_parallel(in->data + in->position,
+                    in->length - in->position, t->dialect.delimiter,
+                    parallel_jobs(options->jobs), render_chunk, t, &t->out);
+            in->position = in->length;
+            t->done = TRUE;
+        }
+    }
+
+    if (!t->error && t->out.error)
+        table_fail(t, t->out.error, "Write error: %s",
+                strerror(t->out.error));
+    return t->error;
+}
+
+void
+table_options_init(TableOptions* options)
+{
+    memset(options, 0, sizeof(TableOptions));
+    options->columns = 80;
+    options->delimiter = ',';
+    options->symbols = TABLE_SYMBOLS_DOUBLE;
+    options->inner_symbols = TABLE_INNER_DOUBLE_SINGLE;
+    options->bold_header = TRUE;
+    options->tab_length = 8;
+    options->sample_rows = 1000;
+    options->sample_bytes = 1024 * 1024;
+    options->jobs = 1;
+    options->rows_count = SIZE_MAX;
+    options->head_rows = SIZE_MAX;
+    options->sort_memory = SORT_MEMORY;
+}
+
+/*
+ * Select the box drawing symbols by name: <border><inner border>, each
+ * a(scii), s(ingle) or d(ouble); ascii only goes with ascii. Returns 0, or
+ * EINVAL for an unknown set.
+ */
+int
+table_set_symbols(TableOptions* options, const char* set)
+{
+    if (!strcmp(set, "aa"))
+    {
+        options->symbols = TABLE_SYMBOLS_ASCII;
+        options->inner_symbols = TABLE_INNER_ASCII_ASCII;
+    }
+    else if (!strcmp(set, "ss"))
+    {
+        options->symbols = TABLE_SYMBOLS_SINGLE;
+        options->inner_symbols = TABLE_INNER_SINGLE_SINGLE;
+    }
+    else if (!strcmp(set, "sd"))
+    {
+        options->symbols = TABLE_SYMBOLS_SINGLE;
+        options->inner_symbols = TABLE_INNER_SINGLE_DOUBLE;
+    }
+    else if (!strcmp(set, "ds"))
+    {
+        options->symbols = TABLE_SYMBOLS_DOUBLE;
+        options->inner_symbols = TABLE_INNER_DOUBLE_SINGLE;
+    }
+    else if (!strcmp(set, "dd"))
+    {
+        options->symbols = TABLE_SYMBOLS_DOUBLE;
+        options->inner_symbols = TABLE_INNER_DOUBLE_DOUBLE;
+    }
+    else
+        return EINVAL;
+    return 0;
+}
+
+/*
+ * Choose what becomes of bytes that are not UTF-8 by name: pass, replace
+ * or error. Returns 0, or EINVAL for an unknown policy.
+ */
+int
+table_set_invalid(TableOptions* options, const char* policy)
+{
+    if (!strcmp(policy, "pass"))
+        options->invalid = TABLE_INVALID_PASS;
+    else if (!strcmp(policy, "replace"))
+        options->invalid = TABLE_INVALID_REPLACE;
+    else if (!strcmp(policy, "error"))
+        options->invalid = TABLE_INVALID_ERROR;
+    else
+        return EINVAL;
+    return 0;
+}
+
+/*
+ * Start a table. Rendered output goes to write, or to standard output if
+ * write is NULL.
+ */
+Table*
+table_new(const TableOptions* options, TableWriteFunc write, void* user)
+{
+    Table* t = NULL;
+
+    pthread_once(&scan_once, scan_init);
+
+    CALLOC(t, Table, 1)
+    t->options = *options;
+    t->options.format = NULL;
+    if (!t->options.tab_length)
+        t->options.tab_length = 8;
+    if (t->options.tail_rows && t->options.head_rows == SIZE_MAX)
+        t->options.head_rows = 0;
+    t->preview = t->options.head_rows != SIZE_MAX || t->options.tail_rows
+        || t->options.max_bytes || t->options.max_time;
+    t->rune_columns = options->columns;
+
+    /* The widths are scaled to the table in place */
+    if (options->format)
+    {
+        while (options->format[t->format_size])
+            t->format_size++;
+        CALLOC(t->format, ULONG, ++t->format_size)
+        memcpy(t->format, options->format, sizeof(ULONG) * t->format_size);
+        t->options.format = t->format;
+    }
+
+    /* Resolved against the header; a single column has nothing to select */
+    if (options->select && !options->border_mode)
+    {
+        size_t length = strlen(options->select) + 1;
+
+        CALLOC(t->select_spec, char, length)
+        memcpy(t->select_spec, options->select, length);
+    }
+    t->options.select = NULL;
+
+    if (options->where)
+    {
+        const char* bad = NULL;
+
+        if (where_parse(&t->where, options->where, &bad))
+            table_fail(t, EINVAL, "Invalid condition: %s", bad);
+    }
+    t->options.where = NULL;
+
+    if (options->sort)
+    {
+        const char* bad = NULL;
+
+        if (sort_parse(&t->sorter, options->sort, &t->dialect,
+                    options->sort_memory, &bad))
+            table_fail(t, EINVAL, "Invalid sort key: %s", bad);
+    }
+    t->options.sort = NULL;
+
+    if (options->ellipsis)
+    {
+        const uint8_t* pellipsis = NULL;
+        ucs4_t uch;
+
+        t->ellipsis_len = strlen(options->ellipsis);
+        CALLOC(t->ellipsis, uint8_t, t->ellipsis_len + 1)
+        memcpy(t->ellipsis, options->ellipsis, t->ellipsis_len);
+        pellipsis = t->ellipsis;
+        while (*pellipsis)
+        {
+            pellipsis += u8_mbtouc(&uch, pellipsis,
+                    t->ellipsis + t->ellipsis_len - pellipsis);
+            t->ellipsis_width += char_width(uch);
+        }
+    }
+    t->options.ellipsis = NULL;
+
+    dialect_init(&t->dialect, options->delimiter, options->strict);
+    t->dialect.max_width = t->rune_columns;
+    t->dialect.validate = options->invalid == TABLE_INVALID_ERROR;
+    if (write)
+        output_init_func(&t->out, write, user);
+    else
+        output_init(&t->out, STDOUT_FILENO);
+    field_list_init(&t->fields);
+
+    return t;
+}
+
+/*
+ * Render what can be rendered of data, following what was fed before.
+ * Records cut off at the end of data are completed by the next call.
+ * Returns 0 or an errno value; see table_error().
+ */
+int
+table_feed(Table* t, const uint8_t* data, size_t length)
+{
+    if (!t->input.pushed)
+    {
+        input_init_push(&t->input);
+        t->input.delimiter = t->dialect.delimiter;
+        if (t->options.max_time)
+            input_set_deadline(&t->input, t->options.max_time);
+    }
+    input_push(&t->input, data, length);
+    table_render_input(t, &t->input);
+    output_flush(&t->out);
+    return t->error;
+}
+
+/*
+ * Render the rest of the fed data and the bottom border, and flush all
+ * output. Returns 0 or an errno value; see table_error().
+ */
+int
+table_finish(Table* t)
+{
+    if (t->input.pushed)
+    {
+        input_end(&t->input);
+        table_render_input(t, &t->input);
+    }
+
+    /* Footer and bottom border */
+    if (t->output_lines && !t->error)
+    {
+        if (t->summary.columns)
+            render_summary(t);
+        render_rule(t, &t->out, RULE_BOTTOM);
+        t->output_lines++;
+    }
+
+    output_flush(&t->out);
+    if (!t->error && t->out.error)
+        table_fail(t, t->out.error, "Write error: %s",
+                strerror(t->out.error));
+    return t->error;
+}
+
+/* Message for the error returned last, or NULL */
+const char*
+table_error(const Table* t)
+{
+    return t->error ? (const char*)t->message : NULL;
+}
+
+void
+table_free(Table* t)
+{
+    if (!t)
+        return;
+    if (t->input.pushed)
+        input_close(&t->input);
+    for (size_t i = 0; i < t->kept; i++)
+        free(t->ring[(t->next + t->options.tail_rows - t->kept + i)
+                % t->options.tail_rows]);
+    free(t->ring);
+    free(t->ring_len);
+    free(t->content_widths);
+    free(t->header);
+    free(t->format);
+    for (size_t i = 0; i < RULE_COUNT; i++)
+        free(t->rules[i]);
+    free(t->header_line);
+    free(t->select_spec);
+    free(t->ellipsis);
+    free(t->select);
+    free(t->measure);
+    where_free(&t->where);
+    sort_free(&t->sorter);
+    summary_free(&t->summary);
+    field_list_free(&t->fields);
+    output_free(&t->out);
+    free(t);
+}
@@ -0,0 +1,112 @@
+/*
+ *    table - Command line utility to format and display CSV.
+ *    Copyright (C) 2020  Страхиња Радић
+ *
+ *    This program is free software: you can redistribute it and/or modify it
+ *    under the terms of the GNU General Public License as published by the Free
+ *    Software Foundation, either version 3 of the License, or (at your option)
+ *    any later version.
+ *
+ *    This program is distributed in the hope that it will be useful, but
+ *    WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *    or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *    for more details.
+ *
+ *    You should have received a copy of the GNU General Public License along
+ *    with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __RENDER_H
+#define __RENDER_H
+
+#include "defs.h"
+#include "index.h"
+#include "input.h"
+#include "libtable.h"
+#include "output.h"
+#include "parse.h"
+#include "sort.h"
+#include "summary.h"
+#include "where.h"
+
+/* Horizontal lines of the table, built once the layout is known */
+enum
+{
+    RULE_TOP,
+    RULE_SEPARATOR,
+    RULE_BOTTOM,
+    RULE_COUNT
+};
+
+/* Position within the row being drawn */
+typedef struct
+{
+    size_t table_column;
+    size_t rune_column;
+} Cursor;
+
+/* Renders a row; see kernel.h */
+typedef void (*RowKernel)(const Table* t, Output* out, const uint8_t* record,
+        const FieldList* list);
+
+/*
+ * Rendering context behind the Table of libtable.h: the options, the layout
+ * fixed by the header row and how far rendering has got. Only the error
+ * fields are written while -j workers render rows.
+ */
+struct Table
+{
+    TableOptions    options;
+    Dialect         dialect;
+    Output          out;
+    Input           input;         /* data given to table_feed() */
+    const RowIndex* index;         /* row offsets for --rows, or NULL */
+    BOOL            preview;       /* --head, --tail or a budget was given */
+    size_t          rune_columns;
+    size_t          table_columns;
+    ULONG*          format;        /* column widths */
+    size_t          format_size;
+    ULONG           format_value;  /* width of every column without format */
+    uint8_t*        ellipsis;      /* --ellipsis, or NULL */
+    size_t          ellipsis_len;
+    size_t          ellipsis_width;
+    RowKernel       row_kernel;    /* renders data rows, set by layout() */
+    uint8_t*        header;
+    size_t          header_len;
+    uint8_t*        header_line;   /* the header row as rendered */
+    size_t          header_line_len;
+    uint8_t*        rules[RULE_COUNT];
+    size_t          rule_len[RULE_COUNT];
+    FieldList       fields;
+    BOOL            resolved;      /* header columns of --select, --where */
+    Where           where;         /* --where, or no conditions */
+    Sorter          sorter;        /* --sort, or no keys */
+    Summary         summary;       /* --summary, once the layout is known */
+    BOOL            sorting;       /* rows are read to be sorted */
+    char*           select_spec;   /* --select, until the header is read */
+    size_t*         select;        /* source column of each table column */
+    size_t          select_count;
+    uint8_t*        measure;       /* source columns that are shown */
+    size_t          source_fields; /* source columns to split records in */
+    size_t*         content_widths;
+    BOOL            sampled;
+    BOOL            sampling;      /* records are measured, not rendered */
+    size_t          lineno;
+    size_t          output_lines;
+    size_t          generation;    /* of the input, see Input */
+    BOOL            tailing;       /* keeping the last rows for --tail */
+    uint8_t**       ring;
+    size_t*         ring_len;
+    size_t          kept;
+    size_t          next;
+    BOOL            skipped;
+    BOOL            done;
+    int             error;
+    uint8_t         message[BUFSIZE];
+};
+
+BOOL table_next_record(Input* in, const uint8_t** record, size_t* record_len);
+int table_render_input(Table* table, Input* in);
+
+#endif
@@ -0,0 +1,201 @@
+/*
+ *    table - Command line utility to format and display CSV.
+ *    Copyright (C) 2020  Страхиња Радић
+ *
+ *    This program is free software: you can redistribute it and/or modify it
+ *    under the terms of the GNU General Public License as published by the Free
+ *    Software Foundation, either version 3 of the License, or (at your option)
+ *    any later version.
+ *
+ *    This program is distributed in the hope that it will be useful, but
+ *    WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *    or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *    for more details.
+ *
+ *    You should have received a copy of the GNU General Public License along
+ *    with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "ring.h"
+#include <pthread.h>
+
+/*
+ * Blocks passed from a producer thread to the reader, in order. Blocks are
+ * produced, taken and released in turn; the producer waits for a released
+ * block and the reader for a produced one.
+ */
+struct Ring
+{
+    uint8_t*        blocks[RING_BLOCKS];
+    size_t          lengths[RING_BLOCKS];
+    size_t          produced;  /* blocks committed */
+    size_t          taken;     /* blocks given to the reader */
+    size_t          released;  /* blocks given back by the reader */
+    BOOL            done;      /* the producer has returned */
+    BOOL            stopping;  /* the reader wants no more */
+    int             error;
+    RingFunc        produce;
+    void*           context;
+    pthread_t       thread;
+    pthread_mutex_t lock;
+    pthread_cond_t  changed;
+};
+
+static void*
+producer(void* arg)
+{
+    Ring* ring = arg;
+    int code = ring->produce(ring, ring->context);
+
+    pthread_mutex_lock(&ring->lock);
+    ring->error = code;
+    ring->done = TRUE;
+    pthread_cond_broadcast(&ring->changed);
+    pthread_mutex_unlock(&ring->lock);
+    return NULL;
+}
+
+/* Run produce on a thread of its own; NULL if one cannot be started */
+Ring*
+ring_start(RingFunc produce, void* context)
+{
+    Ring* ring = NULL;
+    pthread_condattr_t attr;
+
+    CALLOC(ring, Ring, 1)
+    for (size_t i = 0; i < RING_BLOCKS; i++)
+        CALLOC(ring->blocks[i], uint8_t, RING_HEADROOM + RING_BLOCKSIZE)
+    ring->produce = produce;
+    ring->context = context;
+    pthread_mutex_init(&ring->lock, NULL);
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&ring->changed, &attr);
+    pthread_condattr_destroy(&attr);
+    if (pthread_create(&ring->thread, NULL, producer, ring))
+    {
+        ring->produce = NULL;
+        ring_stop(ring);
+        return NULL;
+    }
+    return ring;
+}
+
+/*
+ * Wait for a free block and return where its data goes, RING_BLOCKSIZE
+ * bytes; NULL once the reader has stopped, and the producer should return
+ */
+uint8_t*
+ring_acquire(Ring* ring)
+{
+    uint8_t* data = NULL;
+
+    pthread_mutex_lock(&ring->lock);
+    while (!ring->stopping && ring->produced - ring->released == RING_BLOCKS)
+        pthread_cond_wait(&ring->changed, &ring->lock);
+    if (!ring->stopping)
+        data = ring->blocks[ring->produced % RING_BLOCKS] + RING_HEADROOM;
+    pthread_mutex_unlock(&ring->lock);
+    return data;
+}
+
+/* Hand the block got last over to the reader, with length bytes of data */
+void
+ring_commit(Ring* ring, size_t length)
+{
+    pthread_mutex_lock(&ring->lock);
+    ring->lengths[ring->produced++ % RING_BLOCKS] = length;
+    pthread_cond_broadcast(&ring->changed);
+    pthread_mutex_unlock(&ring->lock);
+}
+
+/* Whether the reader has stopped; lets a producer waiting for input give up */
+BOOL
+ring_stopping(Ring* ring)
+{
+    BOOL stopping;
+
+    pthread_mutex_lock(&ring->lock);
+    stopping = ring->stopping;
+    pthread_mutex_unlock(&ring->lock);
+    return stopping;
+}
+
+/*
+ * Wait for the next block and return its data, which the reader may extend
+ * backwards by up to RING_HEADROOM bytes. The block is the reader's until
+ * it is released. Returns FALSE after the last block, or when deadline
+ * (CLOCK_MONOTONIC, or NULL to wait for as long as it takes) passes first.
+ */
+BOOL
+ring_take(Ring* ring, uint8_t** data, size_t* length,
+        const struct timespec* deadline)
+{
+    BOOL taken = FALSE;
+
+    pthread_mutex_lock(&ring->lock);
+    while (!ring->done && ring->taken == ring->produced)
+    {
+        if (!deadline)
+            pthread_cond_wait(&ring->changed, &ring->lock);
+        else if (pthread_cond_timedwait(&ring->changed, &ring->lock, deadline)
+                == ETIMEDOUT)
+            break;
+    }
+    if (ring->taken < ring->produced)
+    {
+        *data = ring->blocks[ring->taken % RING_BLOCKS] + RING_HEADROOM;
+        *length = ring->lengths[ring->taken++ % RING_BLOCKS];
+        taken = TRUE;
+    }
+    pthread_mutex_unlock(&ring->lock);
+    return taken;
+}
+
+/* The error the producer ended with, once ring_take() returns FALSE */
+int
+ring_error(Ring* ring)
+{
+    int code;
+
+    pthread_mutex_lock(&ring->lock);
+    code = ring->error;
+    pthread_mutex_unlock(&ring->lock);
+    return code;
+}
+
+/* Give back the block taken longest ago, to be filled again */
+void
+ring_release(Ring* ring)
+{
+    pthread_mutex_lock(&ring->lock);
+    ring->released++;
+    pthread_cond_broadcast(&ring->changed);
+    pthread_mutex_unlock(&ring->lock);
+}
+
+/*
+ * Stop the producer, if it is still running, and free the ring. Returns
+ * the error the producer ended with, or 0.
+ */
+int
+ring_stop(Ring* ring)
+{
+    int code;
+
+    pthread_mutex_lock(&ring->lock);
+    ring->stopping = TRUE;
+    pthread_cond_broadcast(&ring->changed);
+    pthread_mutex_unlock(&ring->lock);
+    if (ring->produce)
+        pthread_join(ring->thread, NULL);
+
+    code = ring->error;
+    for (size_t i = 0; i < RING_BLOCKS; i++)
+        free(ring->blocks[i]);
+    pthread_cond_destroy(&ring->changed);
+    pthread_mutex_destroy(&ring->lock);
+    free(ring);
+    return code;
+}
@@ -0,0 +1,55 @@
+/*
+ *    table - Command line utility to format and display CSV.
+ *    Copyright (C) 2020  Страхиња Радић
+ *
+ *    This program is free software: you can redistribute it and/or modify it
+ *    under the terms of the GNU General Public License as published by the Free
+ *    Software Foundation, either version 3 of the License, or (at your option)
+ *    any later version.
+ *
+ *    This program is distributed in the hope that it will be useful, but
+ *    WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *    or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *    for more details.
+ *
+ *    You should have received a copy of the GNU General Public License along
+ *    with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __RING_H
+#define __RING_H
+
+#include "defs.h"
+
+/* Blocks in a ring, and the data a block holds */
+#define RING_BLOCKS    4
+#define RING_BLOCKSIZE (1024 * 1024)
+
+/*
+ * Room before the data of every block, where the reader moves the unread
+ * end of the block before it, so that a record crossing blocks is whole
+ */
+#define RING_HEADROOM  RING_BLOCKSIZE
+
+typedef struct Ring Ring;
+
+/*
+ * Produces the data of a ring on its own thread, filling blocks got with
+ * ring_acquire() and handing them over with ring_commit(). Returns 0, or
+ * an errno value to end the data with an error.
+ */
+typedef int (*RingFunc)(Ring* ring, void* context);
+
+Ring* ring_start(RingFunc produce, void* context);
+uint8_t* ring_acquire(Ring* ring);
+void ring_commit(Ring* ring, size_t length);
+BOOL ring_stopping(Ring* ring);
+BOOL ring_take(Ring* ring, uint8_t** data, size_t* length,
+        const struct timespec* deadline);
+int ring_error(Ring* ring);
+void ring_release(Ring* ring);
+int ring_stop(Ring* ring);
+
+#endif
+
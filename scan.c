@@ -0,0 +1,598 @@
+/*
+ *    table - Command line utility to format and display CSV.
+ *    Copyright (C) 2020  Страхиња Радић
+ *
+ *    This program is free software: you can redistribute it and/or modify it
+ *    under the terms of the GNU General Public License as published by the Free
+ *    Software Foundation, either version 3 of the License, or (at your option)
+ *    any later version.
+ *
+ *    This program is distributed in the hope that it will be useful, but
+ *    WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *    or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *    for more details.
+ *
+ *    You should have received a copy of the GNU General Public License along
+ *    with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "scan.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SCAN_X86
+#include <immintrin.h>
+#endif
+
+static void scan_block_scalar(const uint8_t* block, uint8_t delimiter,
+        ScanMasks* masks);
+static uint32_t scan_digits_scalar(const uint8_t* block);
+static UINT scan_text_scalar(const uint8_t* data, size_t length);
+
+ScanFunc scan_block = scan_block_scalar;
+DigitFunc scan_digits = scan_digits_scalar;
+TextFunc scan_text = scan_text_scalar;
+
+static void
+scan_block_scalar(const uint8_t* block, uint8_t delimiter, ScanMasks* masks)
+{
+    memset(masks, 0, sizeof(ScanMasks));
+
+    for (int i = 0; i < SCAN_BLOCKSIZE; i++)
+    {
+        uint64_t bit = 1ULL << i;
+        uint8_t ch = block[i];
+
+        if (ch == delimiter)
+            masks->delimiter |= bit;
+        if (ch == '"')
+            masks->quote |= bit;
+        else if (ch == '\n')
+            masks->newline |= bit;
+        else if (ch == '\t')
+            masks->tab |= bit;
+        else if (ch >= 0x80)
+            masks->high |= bit;
+    }
+}
+
+static uint32_t
+scan_digits_scalar(const uint8_t* block)
+{
+    uint32_t digits = 0;
+
+    for (int i = 0; i < SCAN_DIGITSIZE; i++)
+        if (block[i] >= '0' && block[i] <= '9')
+            digits |= 1U << i;
+    return digits;
+}
+
+/*
+ * Classify data a character at a time, skipping eight bytes at once while
+ * they are ASCII. Overlong forms, surrogates and code points past U+10FFFF
+ * are invalid.
+ */
+static UINT
+scan_text_scalar(const uint8_t* data, size_t length)
+{
+    UINT text = TEXT_ASCII;
+    size_t i = 0;
+
+    while (i < length)
+    {
+        uint8_t lead = data[i];
+        uint8_t low = 0x80;
+        uint8_t high = 0xBF;
+        size_t tail;
+        uint64_t word;
+
+        if (lead < 0x80)
+        {
+            if (length - i >= sizeof(word))
+            {
+                memcpy(&word, data + i, sizeof(word));
+                if (!(word & 0x8080808080808080ULL))
+                {
+                    i += sizeof(word);
+                    continue;
+                }
+            }
+            i++;
+            continue;
+        }
+
+        if (lead < 0xC2 || lead > 0xF4)
+            return TEXT_INVALID;
+        tail = lead < 0xE0 ? 1 : lead < 0xF0 ? 2 : 3;
+        if (lead == 0xE0)
+            low = 0xA0;
+        else if (lead == 0xED)
+            high = 0x9F;
+        else if (lead == 0xF0)
+            low = 0x90;
+        else if (lead == 0xF4)
+            high = 0x8F;
+        if (length - i <= tail || data[i+1] < low || data[i+1] > high)
+            return TEXT_INVALID;
+        for (size_t k = 2; k <= tail; k++)
+            if ((data[i+k] & 0xC0) != 0x80)
+                return TEXT_INVALID;
+        i += tail + 1;
+        text = TEXT_UTF8;
+    }
+    return text;
+}
+
+#ifdef SCAN_X86
+
+/* Whether the length bytes at data, fewer than a block, are all ASCII */
+static inline BOOL
+ascii_bytes(const uint8_t* data, size_t length)
+{
+    uint64_t bits = 0;
+    uint64_t word;
+    size_t i = 0;
+
+    for (; length - i >= sizeof(word); i += sizeof(word))
+    {
+        memcpy(&word, data + i, sizeof(word));
+        bits |= word;
+    }
+    for (; i < length; i++)
+        bits |= data[i];
+    return !(bits & 0x8080808080808080ULL);
+}
+
+/*
+ * Tables of the vectorized UTF-8 check (Keiser and Lemire, "Validating
+ * UTF-8 In Less Than One Instruction Per Byte"). Each pair of adjacent
+ * bytes is looked up by the high nibble of the first, its low nibble and
+ * the high nibble of the second; a bit left set in all three is an error.
+ */
+#define TOO_SHORT  0x01 /* lead or ASCII after a lead */
+#define TOO_LONG   0x02 /* continuation after ASCII */
+#define OVERLONG_3 0x04
+#define TOO_LARGE  0x08 /* past U+10FFFF */
+#define SURROGATE  0x10
+#define OVERLONG_2 0x20
+#define TOO_LARGE_1000 0x40
+#define OVERLONG_4 0x40
+#define TWO_CONTS  0x80 /* continuation after continuation */
+#define CARRY (TOO_SHORT | TOO_LONG | TWO_CONTS)
+
+static const uint8_t utf8_first_high[16] =
+{
+    TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+    TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+    TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS,
+    TOO_SHORT | OVERLONG_2,
+    TOO_SHORT,
+    TOO_SHORT | OVERLONG_3 | SURROGATE,
+    TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4
+};
+
+static const uint8_t utf8_first_low[16] =
+{
+    CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4,
+    CARRY | OVERLONG_2,
+    CARRY,
+    CARRY,
+    CARRY | TOO_LARGE,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000
+};
+
+static const uint8_t utf8_second_high[16] =
+{
+    TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+    TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000
+        | OVERLONG_4,
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE,
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+    TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT
+};
+
+/*
+ * Bytes that, last in a block, start a sequence that would need bytes of
+ * the next one: a lead in the last byte, a lead of three or four bytes in
+ * the one before it, a lead of four bytes in the one before that
+ */
+static const uint8_t utf8_last_max[32] =
+{
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xF0 - 1, 0xE0 - 1, 0xC0 - 1
+};
+
+#undef TOO_SHORT
+#undef TOO_LONG
+#undef OVERLONG_3
+#undef TOO_LARGE
+#undef SURROGATE
+#undef OVERLONG_2
+#undef TOO_LARGE_1000
+#undef OVERLONG_4
+#undef TWO_CONTS
+#undef CARRY
+
+/*
+ * Errors in block given the block before it, prev: the table lookups
+ * above, and continuations that are missing or extra after leads of three
+ * and four bytes
+ */
+__attribute__((target("ssse3")))
+static inline __m128i
+utf8_errors_ssse3(__m128i block, __m128i prev)
+{
+    const __m128i nibble = _mm_set1_epi8(0x0F);
+    __m128i prev1 = _mm_alignr_epi8(block, prev, 15);
+    __m128i prev2 = _mm_alignr_epi8(block, prev, 14);
+    __m128i prev3 = _mm_alignr_epi8(block, prev, 13);
+    __m128i special = _mm_and_si128(
+            _mm_and_si128(
+                _mm_shuffle_epi8(
+                    _mm_loadu_si128((const __m128i*)utf8_first_high),
+                    _mm_and_si128(_mm_srli_epi16(prev1, 4), nibble)),
+                _mm_shuffle_epi8(
+                    _mm_loadu_si128((const __m128i*)utf8_first_low),
+                    _mm_and_si128(prev1, nibble))),
+            _mm_shuffle_epi8(
+                _mm_loadu_si128((const __m128i*)utf8_second_high),
+                _mm_and_si128(_mm_srli_epi16(block, 4), nibble)));
+    __m128i continuation = _mm_and_si128(
+            _mm_or_si128(_mm_subs_epu8(prev2, _mm_set1_epi8(0xE0 - 0x80)),
+                _mm_subs_epu8(prev3, _mm_set1_epi8(0xF0 - 0x80))),
+            _mm_set1_epi8((char)0x80));
+
+    return _mm_xor_si128(continuation, special);
+}
+
+/*
+ * Classify data 16 bytes at a time. Blocks that are all ASCII are only
+ * checked for a sequence cut short before them; the last, partial block
+ * is padded with ASCII, which catches a sequence cut short by the end,
+ * and is not copied to be padded if it is all ASCII itself.
+ */
+__attribute__((target("ssse3")))
+static UINT
+scan_text_ssse3(const uint8_t* data, size_t length)
+{
+    const __m128i last_max = _mm_loadu_si128(
+            (const __m128i*)(utf8_last_max + 16));
+    __m128i prev = _mm_setzero_si128();
+    __m128i errors = _mm_setzero_si128();
+    BOOL ascii = TRUE;
+
+    for (size_t i = 0; i <= length; i += 16)
+    {
+        __m128i block;
+
+        if (length - i >= 16)
+            block = _mm_loadu_si128((const __m128i*)(data + i));
+        else if (ascii_bytes(data + i, length - i))
+            block = _mm_setzero_si128();
+        else
+        {
+            uint8_t padded[16] = { 0 };
+
+            memcpy(padded, data + i, length - i);
+            block = _mm_loadu_si128((const __m128i*)padded);
+        }
+
+        if (!_mm_movemask_epi8(block))
+            errors = _mm_or_si128(errors, _mm_subs_epu8(prev, last_max));
+        else
+        {
+            ascii = FALSE;
+            errors = _mm_or_si128(errors, utf8_errors_ssse3(block, prev));
+        }
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(errors, _mm_setzero_si128()))
+                != 0xFFFF)
+            return TEXT_INVALID;
+        prev = block;
+    }
+    return ascii ? TEXT_ASCII : TEXT_UTF8;
+}
+
+__attribute__((target("avx2")))
+static inline __m256i
+utf8_errors_avx2(__m256i block, __m256i prev)
+{
+    const __m256i nibble = _mm256_set1_epi8(0x0F);
+    __m256i shifted = _mm256_permute2x128_si256(prev, block, 0x21);
+    __m256i prev1 = _mm256_alignr_epi8(block, shifted, 15);
+    __m256i prev2 = _mm256_alignr_epi8(block, shifted, 14);
+    __m256i prev3 = _mm256_alignr_epi8(block, shifted, 13);
+    __m256i special = _mm256_and_si256(
+            _mm256_and_si256(
+                _mm256_shuffle_epi8(
+                    _mm256_broadcastsi128_si256(_mm_loadu_si128(
+                            (const __m128i*)utf8_first_high)),
+                    _mm256_and_si256(_mm256_srli_epi16(prev1, 4), nibble)),
+                _mm256_shuffle_epi8(
+                    _mm256_broadcastsi128_si256(_mm_loadu_si128(
+                            (const __m128i*)utf8_first_low)),
+                    _mm256_and_si256(prev1, nibble))),
+            _mm256_shuffle_epi8(
+                _mm256_broadcastsi128_si256(_mm_loadu_si128(
+                        (const __m128i*)utf8_second_high)),
+                _mm256_and_si256(_mm256_srli_epi16(block, 4), nibble)));
+    __m256i continuation = _mm256_and_si256(
+            _mm256_or_si256(
+                _mm256_subs_epu8(prev2, _mm256_set1_epi8(0xE0 - 0x80)),
+                _mm256_subs_epu8(prev3, _mm256_set1_epi8(0xF0 - 0x80))),
+            _mm256_set1_epi8((char)0x80));
+
+    return _mm256_xor_si256(continuation, special);
+}
+
+/* As scan_text_ssse3(), 32 bytes at a time */
+__attribute__((target("avx2")))
+static UINT
+scan_text_avx2(const uint8_t* data, size_t length)
+{
+    const __m256i last_max = _mm256_loadu_si256(
+            (const __m256i*)utf8_last_max);
+    __m256i prev = _mm256_setzero_si256();
+    __m256i errors = _mm256_setzero_si256();
+    BOOL ascii = TRUE;
+
+    for (size_t i = 0; i <= length; i += 32)
+    {
+        __m256i block;
+
+        if (length - i >= 32)
+            block = _mm256_loadu_si256((const __m256i*)(data + i));
+        else if (ascii_bytes(data + i, length - i))
+            block = _mm256_setzero_si256();
+        else
+        {
+            uint8_t padded[32] = { 0 };
+
+            memcpy(padded, data + i, length - i);
+            block = _mm256_loadu_si256((const __m256i*)padded);
+        }
+
+        if (!_mm256_movemask_epi8(block))
+            errors = _mm256_or_si256(errors,
+                    _mm256_subs_epu8(prev, last_max));
+        else
+        {
+            ascii = FALSE;
+            errors = _mm256_or_si256(errors, utf8_errors_avx2(block, prev));
+        }
+        if (!_mm256_testz_si256(errors, errors))
+            return TEXT_INVALID;
+        prev = block;
+    }
+    return ascii ? TEXT_ASCII : TEXT_UTF8;
+}
+
+__attribute__((target("sse2")))
+static uint32_t
+scan_digits_sse2(const uint8_t* block)
+{
+    const __m128i nine = _mm_set1_epi8(9);
+    __m128i value = _mm_sub_epi8(_mm_loadu_si128((const __m128i*)block),
+            _mm_set1_epi8('0'));
+
+    /* Digits are the bytes no greater than 9 once '0' is taken away */
+    return (uint16_t)_mm_movemask_epi8(
+            _mm_cmpeq_epi8(_mm_min_epu8(value, nine), value));
+}
+
+__attribute__((target("sse2")))
+static void
+scan_block_sse2(const uint8_t* block, uint8_t delimiter, ScanMasks* masks)
+{
+    const __m128i delim = _mm_set1_epi8((char)delimiter);
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i newline = _mm_set1_epi8('\n');
+    const __m128i tab = _mm_set1_epi8('\t');
+
+    memset(masks, 0, sizeof(ScanMasks));
+
+    for (int i = 0; i < SCAN_BLOCKSIZE; i += 16)
+    {
+        __m128i chunk = _mm_loadu_si128((const __m128i*)(block + i));
+
+        masks->delimiter |= (uint64_t)(uint16_t)_mm_movemask_epi8(
+                _mm_cmpeq_epi8(chunk, delim)) << i;
+        masks->quote |= (uint64_t)(uint16_t)_mm_movemask_epi8(
+                _mm_cmpeq_epi8(chunk, quote)) << i;
+        masks->newline |= (uint64_t)(uint16_t)_mm_movemask_epi8(
+                _mm_cmpeq_epi8(chunk, newline)) << i;
+        masks->tab |= (uint64_t)(uint16_t)_mm_movemask_epi8(
+                _mm_cmpeq_epi8(chunk, tab)) << i;
+        masks->high |= (uint64_t)(uint16_t)_mm_movemask_epi8(chunk) << i;
+    }
+}
+
+__attribute__((target("avx2")))
+static void
+scan_block_avx2(const uint8_t* block, uint8_t delimiter, ScanMasks* masks)
+{
+    const __m256i delim = _mm256_set1_epi8((char)delimiter);
+    const __m256i quote = _mm256_set1_epi8('"');
+    const __m256i newline = _mm256_set1_epi8('\n');
+    const __m256i tab = _mm256_set1_epi8('\t');
+
+    memset(masks, 0, sizeof(ScanMasks));
+
+    for (int i = 0; i < SCAN_BLOCKSIZE; i += 32)
+    {
+        __m256i chunk = _mm256_loadu_si256((const __m256i*)(block + i));
+
+        masks->delimiter |= (uint64_t)(uint32_t)_mm256_movemask_epi8(
+                _mm256_cmpeq_epi8(chunk, delim)) << i;
+        masks->quote |= (uint64_t)(uint32_t)_mm256_movemask_epi8(
+                _mm256_cmpeq_epi8(chunk, quote)) << i;
+        masks->newline |= (uint64_t)(uint32_t)_mm256_movemask_epi8(
+                _mm256_cmpeq_epi8(chunk, newline)) << i;
+        masks->tab |= (uint64_t)(uint32_t)_mm256_movemask_epi8(
+                _mm256_cmpeq_epi8(chunk, tab)) << i;
+        masks->high |= (uint64_t)(uint32_t)_mm256_movemask_epi8(chunk) << i;
+    }
+}
+
+#endif
+
+/* Pick the widest scanner the CPU supports */
+void
+scan_init(void)
+{
+#ifdef SCAN_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2"))
+        scan_digits = scan_digits_sse2;
+    if (__builtin_cpu_supports("avx2"))
+        scan_text = scan_text_avx2;
+    else if (__builtin_cpu_supports("ssse3"))
+        scan_text = scan_text_ssse3;
+    if (__builtin_cpu_supports("avx2"))
+        scan_block = scan_block_avx2;
+    else if (__builtin_cpu_supports("sse2"))
+        scan_block = scan_block_sse2;
+    else
+#endif
+        scan_block = scan_block_scalar;
+}
+
+/* Scan the last, partial block of a buffer without reading past its end */
+void
+scan_tail(const uint8_t* block, size_t length, uint8_t delimiter,
+        ScanMasks* masks)
+{
+    uint8_t padded[SCAN_BLOCKSIZE] = { 0 };
+    uint64_t valid = length < SCAN_BLOCKSIZE ? (1ULL << length) - 1 : ~0ULL;
+
+    memcpy(padded, block, length < SCAN_BLOCKSIZE ? length : SCAN_BLOCKSIZE);
+    scan_block(padded, delimiter, masks);
+    masks->delimiter &= valid;
+    masks->quote &= valid;
+    masks->newline &= valid;
+    masks->tab &= valid;
+    masks->high &= valid;
+}
+
+
+/*
+ * Quoting at the end of data, read on from state, as far as record
+ * boundaries go. A '"' opens quoting only at the start of a field or right
+ * after the quote that closed it (an escaped quote), as in the state
+ * machine of the lenient dialect; elsewhere outside of quotes it is an
+ * ordinary character. A line break outside of quotes ends the record.
+ */
+UINT
+scan_quoting(const uint8_t* data, size_t length, ucs4_t delimiter,
+        UINT state)
+{
+    const uint8_t* end = data + length;
+    const uint8_t* p = data;
+    const uint8_t* closed = state == SCAN_CLOSED ? data : NULL;
+    BOOL quoted = state == SCAN_QUOTED;
+    uint8_t delim[6];
+    int delim_len = u8_uctomb(delim, delimiter, sizeof(delim));
+
+    if (!length)
+        return state;
+    if (delim_len < 1)
+        delim_len = 0;
+
+    while ((p = memchr(p, '"', end - p)))
+    {
+        if (quoted)
+        {
+            quoted = FALSE;
+            closed = p + 1;
+        }
+        else if (p == closed
+                || (p == data ? state == SCAN_FIELD
+                    : p[-1] == '\n'
+                        || (delim_len && p - data >= delim_len
+                            && !memcmp(p - delim_len, delim, delim_len))))
+            quoted = TRUE;
+        p++;
+    }
+
+    if (quoted)
+        return SCAN_QUOTED;
+    if (closed == end)
+        return SCAN_CLOSED;
+    if (end[-1] == '\n' || (delim_len && length >= (size_t)delim_len
+                && !memcmp(end - delim_len, delim, delim_len)))
+        return SCAN_FIELD;
+    return SCAN_UNQUOTED;
+}
+
+/*
+ * Offset of the delimiter or line break that ends the field data is in,
+ * reading on from *state as scan_quoting() does, or length if the field
+ * goes on past data. Sets *state to the quoting there. The delimiter is
+ * ASCII, so the blocks are classified by the SIMD scanner.
+ */
+size_t
+scan_field_end(const uint8_t* data, size_t length, uint8_t delimiter,
+        UINT* state)
+{
+    UINT quoting = *state;
+    size_t at = 0; /* where quoting was last set */
+    ScanMasks masks;
+
+    for (size_t block = 0; block < length; block += SCAN_BLOCKSIZE)
+    {
+        uint64_t structural;
+
+        if (length - block >= SCAN_BLOCKSIZE)
+            scan_block(data + block, delimiter, &masks);
+        else
+            scan_tail(data + block, length - block, delimiter, &masks);
+
+        structural = masks.quote | masks.delimiter | masks.newline;
+        while (structural)
+        {
+            size_t bit = __builtin_ctzll(structural);
+            size_t offset = block + bit;
+
+            structural &= structural - 1;
+            if (quoting == SCAN_QUOTED)
+            {
+                if (masks.quote & (1ULL << bit))
+                {
+                    quoting = SCAN_CLOSED;
+                    at = offset + 1;
+                }
+                continue;
+            }
+
+            /* Text since the start of the field or a closing quote */
+            if (offset > at)
+                quoting = SCAN_UNQUOTED;
+            if (!(masks.quote & (1ULL << bit)))
+            {
+                *state = quoting;
+                return offset;
+            }
+            if (quoting != SCAN_UNQUOTED)
+                quoting = SCAN_QUOTED;
+            at = offset + 1;
+        }
+    }
+
+    if (quoting != SCAN_QUOTED && length > at)
+        quoting = SCAN_UNQUOTED;
+    *state = quoting;
+    return length;
+}
@@ -0,0 +1,76 @@
+/*
+ *    table - Command line utility to format and display CSV.
+ *    Copyright (C) 2020  Страхиња Радић
+ *
+ *    This program is free software: you can redistribute it and/or modify it
+ *    under the terms of the GNU General Public License as published by the Free
+ *    Software Foundation, either version 3 of the License, or (at your option)
+ *    any later version.
+ *
+ *    This program is distributed in the hope that it will be useful, but
+ *    WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *    or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *    for more details.
+ *
+ *    You should have received a copy of the GNU General Public License along
+ *    with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __SCAN_H
+#define __SCAN_H
+
+#include "defs.h"
+
+#define SCAN_BLOCKSIZE 64
+
+/*
+ * Positions of structural characters within one SCAN_BLOCKSIZE byte block;
+ * bit i of each mask corresponds to byte i of the block
+ */
+typedef struct
+{
+    uint64_t delimiter;
+    uint64_t quote;
+    uint64_t newline;
+    uint64_t tab;
+    uint64_t high;      /* bytes >= 0x80, i.e. parts of non-ASCII characters */
+} ScanMasks;
+
+typedef void (*ScanFunc)(const uint8_t* block, uint8_t delimiter,
+        ScanMasks* masks);
+
+/* Quoting at a point of the input, see scan_quoting() */
+#define SCAN_FIELD    0 /* at the start of a field */
+#define SCAN_UNQUOTED 1
+#define SCAN_QUOTED   2
+#define SCAN_CLOSED   3 /* right after the quote that closed a field */
+
+/* Bytes classified at a time by scan_digits() */
+#define SCAN_DIGITSIZE 16
+
+/* Mask of the bytes of a SCAN_DIGITSIZE byte block that are ASCII digits */
+typedef uint32_t (*DigitFunc)(const uint8_t* block);
+
+/* What scan_text() finds a buffer to hold */
+#define TEXT_ASCII   0
+#define TEXT_UTF8    1 /* valid UTF-8, not all of it ASCII */
+#define TEXT_INVALID 2 /* bytes that are not UTF-8, or a sequence cut short */
+
+typedef UINT (*TextFunc)(const uint8_t* data, size_t length);
+
+/* Scanner and classifiers for the current CPU, selected by scan_init() */
+extern ScanFunc scan_block;
+extern DigitFunc scan_digits;
+extern TextFunc scan_text;
+
+void scan_init(void);
+void scan_tail(const uint8_t* block, size_t length, uint8_t delimiter,
+        ScanMasks* masks);
+UINT scan_quoting(const uint8_t* data, size_t length, ucs4_t delimiter,
+        UINT state);
+size_t scan_field_end(const uint8_t* data, size_t length, uint8_t delimiter,
+        UINT* state);
+
+#endif
+
@@ -0,0 +1,603 @@
+/*
+ *    table - Command line utility to format and display CSV.
+ *    Copyright (C) 2020  Страхиња Радић
+ *
+ *    This program is free software: you can redistribute it and/or modify it
+ *    under the terms of the GNU General Public License as published by the Free
+ *    Software Foundation, either version 3 of the License, or (at your option)
+ *    any later version.
+ *
+ *    This program is distributed in the hope that it will be useful, but
+ *    WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *    or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *    for more details.
+ *
+ *    You should have received a copy of the GNU General Public License along
+ *    with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "defs.h"
+#include "sort.h"
+
+static void*
+arena_alloc(Arena* arena, size_t size)
+{
+    size_t block_size = arena->block_size ? arena->block_size
+        : SORT_BLOCKSIZE;
+    uint8_t* block;
+
+    /* Keys are kept aligned */
+    size = (size + sizeof(double) - 1) & ~(sizeof(double) - 1);
+    if (!arena->count || arena->used + size > arena->capacity)
+    {
+        if (arena->count == arena->size)
+        {
+            arena->size = arena->size ? arena->size * 2 : 16;
+            REALLOCARRAY(arena->blocks, uint8_t*, arena->size)
+        }
+        arena->capacity = size > block_size ? size : block_size;
+        CALLOC(arena->blocks[arena->count], uint8_t, arena->capacity)
+        arena->count++;
+        arena->used = 0;
+    }
+    block = arena->blocks[arena->count-1] + arena->used;
+    arena->used += size;
+    return block;
+}
+
+/* Free all that was allocated but the first block, which is reused */
+static void
+arena_reset(Arena* arena)
+{
+    while (arena->count > 1)
+        free(arena->blocks[--arena->count]);
+    arena->used = 0;
+    if (arena->count)
+        arena->capacity = arena->block_size ? arena->block_size
+            : SORT_BLOCKSIZE;
+}
+
+static void
+arena_free(Arena* arena)
+{
+    for (size_t i = 0; i < arena->count; i++)
+        free(arena->blocks[i]);
+    free(arena->blocks);
+    arena->blocks = NULL;
+    arena->count = arena->size = 0;
+}
+
+/*
+ * Parse the keys of --sort: columns separated by commas, each optionally
+ * followed by ':' and n (compare as numbers), r (reverse) or both. Returns
+ * 0, or EINVAL with bad pointing at the key that could not be read.
+ */
+int
+sort_parse(Sorter* sorter, const char* spec, const Dialect* dialect,
+        size_t memory, const char** bad)
+{
+    const char* item = spec;
+    size_t size = 0;
+
+    memset(sorter, 0, sizeof(Sorter));
+    sorter->dialect = dialect;
+    sorter->memory = memory ? memory : SORT_MEMORY;
+    field_list_init(&sorter->fields);
+
+    while (TRUE)
+    {
+        const char* end = item + strcspn(item, ",");
+        const char* flags = end;
+        size_t length;
+        SortKey* key;
+
+        *bad = item;
+        while (flags > item && flags[-1] != ':')
+            flags--;
+        if (flags == item || strspn(flags, "nr") < (size_t)(end - flags))
+            flags = end + 1;
+        length = flags - 1 - item;
+        if (!length)
+            return EINVAL;
+
+        if (sorter->key_count == size)
+        {
+            size = size ? size * 2 : 4;
+            REALLOCARRAY(sorter->keys, SortKey, size)
+        }
+        key = sorter->keys + sorter->key_count++;
+        memset(key, 0, sizeof(SortKey));
+        CALLOC(key->column, char, length + 1)
+        memcpy(key->column, item, length);
+        for (const char* pflag = flags; pflag < end; pflag++)
+            if (*pflag == 'n')
+                key->numeric = TRUE;
+            else
+                key->reverse = TRUE;
+
+        if (!*end)
+            return 0;
+        item = end + 1;
+    }
+}
+
+/*
+ * Find the columns of the keys in the header row, split into all of its
+ * fields. Returns FALSE with missing set to a column that is not there.
+ */
+BOOL
+sort_resolve(Sorter* sorter, const uint8_t* header, const FieldList* list,
+        const char** missing)
+{
+    size_t last = 0;
+
+    for (size_t i = 0; i < sorter->key_count; i++)
+    {
+        SortKey* key = sorter->keys + i;
+
+        key->field = field_list_find(list, header, key->column,
+                strlen(key->column));
+        if (key->field >= list->count)
+        {
+            *missing = key->column;
+            return FALSE;
+        }
+        if (key->field > last)
+            last = key->field;
+    }
+
+    /* As the renderer does, the last column takes the rest of a record */
+    sorter->max_fields = last + 2 < list->count ? last + 2 : list->count;
+    CALLOC(sorter->measure, uint8_t, sorter->max_fields)
+    return TRUE;
+}
+
+/* Find the keys of a record, allocating what they need from arena */
+static void
+sort_values(Sorter* sorter, SortRecord* record, Arena* arena)
+{
+    FieldList* list = &sorter->fields;
+
+    parse_record(record->data, record->length, sorter->dialect,
+            sorter->max_fields, sorter->measure, list);
+    record->values = arena_alloc(arena, sizeof(SortValue)
+            * sorter->key_count);
+    for (size_t i = 0; i < sorter->key_count; i++)
+    {
+        const SortKey* key = sorter->keys + i;
+        SortValue* value = record->values + i;
+
+        value->text = (const uint8_t*)"";
+        value->length = 0;
+        if (key->field < list->count)
+        {
+            value->text = record->data + list->fields[key->field].offset;
+            value->length = list->fields[key->field].length;
+        }
+        if (memchr(value->text, '"', value->length))
+        {
+            uint8_t* text = arena_alloc(arena, value->length);
+
+            value->length = field_unquote(value->text, value->length, text);
+            value->text = text;
+        }
+        value->is_number = key->numeric
+            && field_number(value->text, value->length, &value->number);
+    }
+}
+
+/*
+ * Order of two records by the keys. Text is compared byte by byte; with n,
+ * numbers come in numeric order after fields that are not numbers.
+ */
+static int
+compare_records(const Sorter* sorter, const SortRecord* a,
+        const SortRecord* b)
+{
+    for (size_t i = 0; i < sorter->key_count; i++)
+    {
+        const SortValue* x = a->values + i;
+        const SortValue* y = b->values + i;
+        int order;
+
+        if (x->is_number && y->is_number)
+            order = (x->number > y->number) - (x->number < y->number);
+        else if (x->is_number != y->is_number)
+            order = x->is_number ? 1 : -1;
+        else
+        {
+            order = memcmp(x->text, y->text,
+                    x->length < y->length ? x->length : y->length);
+            if (!order)
+                order = (x->length > y->length) - (x->length < y->length);
+        }
+        if (order)
+            return sorter->keys[i].reverse ? -order : order;
+    }
+    return 0;
+}
+
+/* Stable merge sort of the records held in memory */
+static void
+sort_records(const Sorter* sorter)
+{
+    SortRecord* from = sorter->records;
+    SortRecord* to = NULL;
+    size_t count = sorter->count;
+
+    if (count < 2)
+        return;
+    CALLOC(to, SortRecord, count)
+
+    for (size_t width = 1; width < count; width *= 2)
+    {
+        SortRecord* swap;
+
+        for (size_t start = 0; start < count; start += 2 * width)
+        {
+            size_t middle = start + width < count ? start + width : count;
+            size_t end = middle + width < count ? middle + width : count;
+            size_t i = start;
+            size_t j = middle;
+            size_t k = start;
+
+            while (i < middle && j < end)
+                to[k++] = compare_records(sorter, from + j, from + i) < 0
+                    ? from[j++] : from[i++];
+            while (i < middle)
+                to[k++] = from[i++];
+            while (j < end)
+                to[k++] = from[j++];
+        }
+        swap = from;
+        from = to;
+        to = swap;
+    }
+
+    if (from != sorter->records)
+    {
+        memcpy(sorter->records, from, sizeof(SortRecord) * count);
+        to = from;
+    }
+    free(to);
+}
+
+/* Open an unnamed temporary file in $TMPDIR, or /tmp */
+static int
+temp_file(FILE** file)
+{
+    const char* dir = getenv("TMPDIR");
+    char* path = NULL;
+    int fd;
+
+    if (!dir || !*dir)
+        dir = "/tmp";
+    CALLOC(path, char, strlen(dir) + sizeof("/tableXXXXXX"))
+    sprintf(path, "%s/tableXXXXXX", dir);
+    fd = mkstemp(path);
+    if (fd >= 0)
+        unlink(path);
+    free(path);
+    if (fd < 0)
+        return errno;
+    if (!(*file = fdopen(fd, "w+b")))
+    {
+        int code = errno;
+        close(fd);
+        return code;
+    }
+    return 0;
+}
+
+static int
+write_record(FILE* file, const uint8_t* data, size_t length)
+{
+    if (fwrite(&length, sizeof(length), 1, file) != 1
+            || fwrite(data, 1, length, file) != length)
+        return errno ? errno : EIO;
+    return 0;
+}
+
+/* Read the next record of a run and its keys; FALSE at its end */
+static BOOL
+read_record(Sorter* sorter, SortRun* run, int* code)
+{
+    size_t length;
+
+    if (fread(&length, sizeof(length), 1, run->file) != 1)
+    {
+        if (ferror(run->file))
+            *code = EIO;
+        return FALSE;
+    }
+    if (length > run->size)
+    {
+        run->size = length;
+        REALLOC(run->data, uint8_t, run->size)
+    }
+    if (fread(run->data, 1, length, run->file) != length)
+    {
+        *code = EIO;
+        return FALSE;
+    }
+    run->record.data = run->data;
+    run->record.length = length;
+    arena_reset(&run->arena);
+    sort_values(sorter, &run->record, &run->arena);
+    return TRUE;
+}
+
+/* Whether run a comes before run b; runs keep the order of the input */
+static BOOL
+run_before(const Sorter* sorter, size_t a, size_t b)
+{
+    int order = compare_records(sorter, &sorter->runs[a].record,
+            &sorter->runs[b].record);
+
+    return order < 0 || (order == 0 && a < b);
+}
+
+static void
+sift_down(Sorter* sorter, size_t i)
+{
+    size_t* heap = sorter->heap;
+
+    while (TRUE)
+    {
+        size_t first = i;
+        size_t left = 2 * i + 1;
+        size_t right = left + 1;
+        size_t swap;
+
+        if (left < sorter->heap_count
+                && run_before(sorter, heap[left], heap[first]))
+            first = left;
+        if (right < sorter->heap_count
+                && run_before(sorter, heap[right], heap[first]))
+            first = right;
+        if (first == i)
+            return;
+        swap = heap[i];
+        heap[i] = heap[first];
+        heap[first] = swap;
+        i = first;
+    }
+}
+
+/*
+ * Read the runs from first on from their starts and order them by their
+ * first records
+ */
+static int
+start_merge(Sorter* sorter, size_t first)
+{
+    int code = 0;
+
+    CALLOC(sorter->heap, size_t, sorter->run_count - first)
+    sorter->heap_count = 0;
+    sorter->advance = FALSE;
+    for (size_t i = first; i < sorter->run_count; i++)
+    {
+        if (fflush(sorter->runs[i].file)
+                || fseek(sorter->runs[i].file, 0, SEEK_SET))
+            return errno;
+        if (read_record(sorter, sorter->runs + i, &code))
+            sorter->heap[sorter->heap_count++] = i;
+        if (code)
+            return code;
+    }
+    for (size_t i = sorter->heap_count; i-- > 0;)
+        sift_down(sorter, i);
+    return 0;
+}
+
+/* Close the runs from first on */
+static void
+close_runs(Sorter* sorter, size_t first)
+{
+    for (size_t i = first; i < sorter->run_count; i++)
+    {
+        fclose(sorter->runs[i].file);
+        free(sorter->runs[i].data);
+        arena_free(&sorter->runs[i].arena);
+    }
+    sorter->run_count = first;
+    free(sorter->heap);
+    sorter->heap = NULL;
+    sorter->heap_count = 0;
+}
+
+static void
+add_run(Sorter* sorter, FILE* file, size_t level)
+{
+    REALLOCARRAY(sorter->runs, SortRun, (sorter->run_count + 1))
+    memset(sorter->runs + sorter->run_count, 0, sizeof(SortRun));
+    sorter->runs[sorter->run_count].arena.block_size = SORT_RUN_BLOCKSIZE;
+    sorter->runs[sorter->run_count].level = level;
+    sorter->runs[sorter->run_count++].file = file;
+}
+
+/*
+ * Merge the runs from first on into one, which takes their place in the
+ * order of the input and the level above the highest of theirs
+ */
+static int
+merge_runs(Sorter* sorter, size_t first)
+{
+    const uint8_t* data = NULL;
+    size_t length = 0;
+    size_t level = 0;
+    FILE* file = NULL;
+    int code = temp_file(&file);
+
+    for (size_t i = first; i < sorter->run_count; i++)
+        if (sorter->runs[i].level > level)
+            level = sorter->runs[i].level;
+    if (!code)
+        code = start_merge(sorter, first);
+    while (!code && !(code = sort_next(sorter, &data, &length)) && data)
+        code = write_record(file, data, length);
+    close_runs(sorter, first);
+    if (code)
+    {
+        if (file)
+            fclose(file);
+        return code;
+    }
+    add_run(sorter, file, level + 1);
+    return 0;
+}
+
+/* Sort the records held in memory and write them out as a run */
+static int
+spill(Sorter* sorter)
+{
+    FILE* file = NULL;
+    int code = temp_file(&file);
+
+    if (code)
+        return code;
+    sort_records(sorter);
+    for (size_t i = 0; i < sorter->count && !code; i++)
+        code = write_record(file, sorter->records[i].data,
+                sorter->records[i].length);
+    if (!code && fflush(file))
+        code = errno;
+    if (code)
+    {
+        fclose(file);
+        return code;
+    }
+    add_run(sorter, file, 0);
+
+    sorter->count = 0;
+    sorter->held = 0;
+    arena_reset(&sorter->arena);
+
+    /* Levels only go down along the runs, so SORT_FANIN runs of a level
+     * are the last ones. Merging only those writes every row once per
+     * level, and keeps fewer than SORT_FANIN runs of each open. */
+    while (!code && sorter->run_count >= SORT_FANIN
+            && sorter->runs[sorter->run_count - SORT_FANIN].level
+                == sorter->runs[sorter->run_count - 1].level)
+        code = merge_runs(sorter, sorter->run_count - SORT_FANIN);
+    return code;
+}
+
+/*
+ * Add a record to be sorted, copying it unless it stays where it is until
+ * the end. Returns 0, or an errno value if a run could not be written.
+ */
+int
+sort_add(Sorter* sorter, const uint8_t* data, size_t length, BOOL copy)
+{
+    SortRecord* record;
+
+    if (sorter->count == sorter->size)
+    {
+        sorter->size = sorter->size ? sorter->size * 2 : 1024;
+        REALLOCARRAY(sorter->records, SortRecord, sorter->size)
+    }
+    record = sorter->records + sorter->count++;
+    if (copy)
+    {
+        uint8_t* pcopy = arena_alloc(&sorter->arena, length);
+
+        memcpy(pcopy, data, length);
+        data = pcopy;
+    }
+    record->data = data;
+    record->length = length;
+    sort_values(sorter, record, &sorter->arena);
+    sorter->total++;
+
+    sorter->held += length + sizeof(SortRecord)
+        + sizeof(SortValue) * sorter->key_count;
+    return sorter->held >= sorter->memory ? spill(sorter) : 0;
+}
+
+/*
+ * Sort what was added: in memory if it all fit, else by writing out the
+ * rest as one more run and merging the runs. Returns 0 or an errno value.
+ */
+int
+sort_finish(Sorter* sorter)
+{
+    int code = 0;
+
+    sorter->next = 0;
+    if (!sorter->run_count)
+    {
+        sort_records(sorter);
+        return 0;
+    }
+    if (sorter->count && (code = spill(sorter)))
+        return code;
+
+    /* Merge the smallest runs until at most SORT_FANIN are left */
+    while (sorter->run_count > SORT_FANIN)
+    {
+        size_t merged = sorter->run_count - SORT_FANIN + 1;
+
+        if (merged > SORT_FANIN)
+            merged = SORT_FANIN;
+        if ((code = merge_runs(sorter, sorter->run_count - merged)))
+            return code;
+    }
+    return start_merge(sorter, 0);
+}
+
+/*
+ * Give out the next record in order, valid until the next call; NULL after
+ * the last one. Returns 0, or an errno value if a run could not be read.
+ */
+int
+sort_next(Sorter* sorter, const uint8_t** data, size_t* length)
+{
+    SortRun* run;
+    int code = 0;
+
+    *data = NULL;
+    if (!sorter->run_count)
+    {
+        if (sorter->next < sorter->count)
+        {
+            *data = sorter->records[sorter->next].data;
+            *length = sorter->records[sorter->next++].length;
+        }
+        return 0;
+    }
+
+    if (sorter->advance && sorter->heap_count)
+    {
+        if (!read_record(sorter, sorter->runs + sorter->heap[0], &code))
+            sorter->heap[0] = sorter->heap[--sorter->heap_count];
+        if (code)
+            return code;
+        sift_down(sorter, 0);
+    }
+    if (!sorter->heap_count)
+        return 0;
+
+    run = sorter->runs + sorter->heap[0];
+    *data = run->record.data;
+    *length = run->record.length;
+    sorter->advance = TRUE;
+    return 0;
+}
+
+void
+sort_free(Sorter* sorter)
+{
+    for (size_t i = 0; i < sorter->key_count; i++)
+        free(sorter->keys[i].column);
+    free(sorter->keys);
+    free(sorter->measure);
+    field_list_free(&sorter->fields);
+    free(sorter->records);
+    arena_free(&sorter->arena);
+    close_runs(sorter, 0);
+    free(sorter->runs);
+    memset(sorter, 0, sizeof(Sorter));
+}
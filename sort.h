@@ -0,0 +1,120 @@
+/*
+ *    table - Command line utility to format and display CSV.
+ *    Copyright (C) 2020  Страхиња Радић
+ *
+ *    This program is free software: you can redistribute it and/or modify it
+ *    under the terms of the GNU General Public License as published by the Free
+ *    Software Foundation, either version 3 of the License, or (at your option)
+ *    any later version.
+ *
+ *    This program is distributed in the hope that it will be useful, but
+ *    WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *    or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *    for more details.
+ *
+ *    You should have received a copy of the GNU General Public License along
+ *    with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __SORT_H
+#define __SORT_H
+
+#include "defs.h"
+#include "parse.h"
+
+/* Default memory for rows held by --sort before they go to a run file */
+#define SORT_MEMORY (64 * 1024 * 1024)
+
+/* Run files merged at most at once */
+#define SORT_FANIN 64
+
+/* Bytes allocated at once for rows and keys, and for the keys of a run */
+#define SORT_BLOCKSIZE     (1024 * 1024)
+#define SORT_RUN_BLOCKSIZE 4096
+
+typedef struct
+{
+    char*  column;  /* as given: a number or a header name */
+    size_t field;   /* source column, from 0, once resolved */
+    BOOL   numeric; /* :n */
+    BOOL   reverse; /* :r */
+} SortKey;
+
+/* A key of a record, as it is compared */
+typedef struct
+{
+    const uint8_t* text;   /* without the quoting */
+    size_t         length;
+    double         number;
+    BOOL           is_number;
+} SortValue;
+
+typedef struct
+{
+    const uint8_t* data;
+    size_t         length;
+    SortValue*     values; /* one for every key */
+} SortRecord;
+
+/* Blocks that rows and keys are allocated from and freed with at once */
+typedef struct
+{
+    uint8_t** blocks;
+    size_t    count;
+    size_t    size;
+    size_t    used;        /* of the last block */
+    size_t    capacity;    /* of the last block */
+    size_t    block_size;  /* 0 for SORT_BLOCKSIZE */
+} Arena;
+
+/* Sorted rows spilled to a temporary file, and the one read last */
+typedef struct
+{
+    FILE*      file;
+    uint8_t*   data;
+    size_t     size;
+    SortRecord record;
+    Arena      arena;      /* keys of record */
+    size_t     level;      /* merges its rows have been through */
+} SortRun;
+
+/*
+ * Rows for --sort: held in memory up to the memory budget, then sorted and
+ * written out as a run, to be merged with the other runs at the end
+ */
+typedef struct
+{
+    SortKey*       keys;
+    size_t         key_count;
+    const Dialect* dialect;
+    size_t         memory;
+    size_t         max_fields;  /* split records in for the keys */
+    uint8_t*       measure;     /* no field, see parse_record() */
+    FieldList      fields;
+    SortRecord*    records;
+    size_t         count;
+    size_t         size;
+    size_t         held;        /* bytes of the records in memory */
+    Arena          arena;
+    size_t         total;       /* records added */
+    SortRun*       runs;
+    size_t         run_count;
+    size_t*        heap;        /* runs being merged, the next one first */
+    size_t         heap_count;
+    BOOL           advance;     /* the first run has been read from */
+    size_t         next;        /* record to give out, without runs */
+} Sorter;
+
+int sort_parse(Sorter* sorter, const char* spec, const Dialect* dialect,
+        size_t memory, const char** bad);
+BOOL sort_resolve(Sorter* sorter, const uint8_t* header, const FieldList* list,
+        const char** missing);
+int sort_add(Sorter* sorter, const uint8_t* record, size_t length,
+        BOOL copy);
+int sort_finish(Sorter* sorter);
+int sort_next(Sorter* sorter, const uint8_t** record, size_t* length);
+void sort_free(Sorter* sorter);
+
+#endif
+
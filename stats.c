@@ -0,0 +1,103 @@
+/*
+ *    table - Command line utility to format and display CSV.
+ *    Copyright (C) 2020  Страхиња Радић
+ *
+ *    This program is free software: you can redistribute it and/or modify it
+ *    under the terms of the GNU General Public License as published by the Free
+ *    Software Foundation, either version 3 of the License, or (at your option)
+ *    any later version.
+ *
+ *    This program is distributed in the hope that it will be useful, but
+ *    WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *    or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *    for more details.
+ *
+ *    You should have received a copy of the GNU General Public License along
+ *    with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "defs.h"
+
+#ifdef TABLE_STATS
+
+Stats stats;
+
+/* Phase each thread is in, and since when */
+static __thread int current_phase = STATS_OTHER;
+static __thread uint64_t phase_start = 0;
+
+static uint64_t
+now_ns()
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+/* Switch the calling thread to phase; returns the phase it was in */
+int
+stats_phase(int phase)
+{
+    uint64_t now = now_ns();
+    int previous = current_phase;
+
+    if (phase_start)
+        __atomic_fetch_add(&stats.phase_ns[previous], now - phase_start,
+                __ATOMIC_RELAXED);
+    current_phase = phase;
+    phase_start = now;
+    return previous;
+}
+
+void
+stats_max(size_t* counter, size_t value)
+{
+    size_t seen = __atomic_load_n(counter, __ATOMIC_RELAXED);
+
+    while (value > seen
+            && !__atomic_compare_exchange_n(counter, &seen, value, FALSE,
+                __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+}
+
+/*
+ * Print the counters, as a JSON object or as text. seconds is the wall
+ * time of the whole run; phase times are summed over threads.
+ */
+void
+stats_print(FILE* file, int json, double seconds)
+{
+    const char* format = json
+        ? "{\"bytes_read\":%zu,\"bytes_written\":%zu,\"records\":%zu,"
+          "\"fields\":%zu,\"truncated_cells\":%zu,\"longest_line\":%zu,"
+          "\"allocations\":%zu,\"reallocations\":%zu,"
+          "\"read_seconds\":%.6f,\"parse_seconds\":%.6f,"
+          "\"sort_seconds\":%.6f,\"render_seconds\":%.6f,"
+          "\"total_seconds\":%.6f}\n"
+        : "bytes read       %zu\n"
+          "bytes written    %zu\n"
+          "records          %zu\n"
+          "fields           %zu\n"
+          "truncated cells  %zu\n"
+          "longest line     %zu\n"
+          "allocations      %zu\n"
+          "reallocations    %zu\n"
+          "read time        %.6f s\n"
+          "parse time       %.6f s\n"
+          "sort time        %.6f s\n"
+          "render time      %.6f s\n"
+          "total time       %.6f s\n";
+
+    stats_phase(STATS_OTHER);
+    fprintf(file, format, stats.bytes_read, stats.bytes_written,
+            stats.records, stats.fields, stats.truncated, stats.longest_line,
+            stats.allocations, stats.reallocations,
+            stats.phase_ns[STATS_READ] / 1e9,
+            stats.phase_ns[STATS_PARSE] / 1e9,
+            stats.phase_ns[STATS_SORT] / 1e9,
+            stats.phase_ns[STATS_RENDER] / 1e9, seconds);
+}
+
+#endif
@@ -0,0 +1,254 @@
+/*
+ *    table - Command line utility to format and display CSV.
+ *    Copyright (C) 2020  Страхиња Радић
+ *
+ *    This program is free software: you can redistribute it and/or modify it
+ *    under the terms of the GNU General Public License as published by the Free
+ *    Software Foundation, either version 3 of the License, or (at your option)
+ *    any later version.
+ *
+ *    This program is distributed in the hope that it will be useful, but
+ *    WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *    or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *    for more details.
+ *
+ *    You should have received a copy of the GNU General Public License along
+ *    with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "scan.h"
+#include "summary.h"
+
+/* Powers of ten up to the most decimals read_number() converts itself */
+static const double powers_of_ten[] =
+{
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12,
+    1e13, 1e14, 1e15
+};
+
+/* Digits of the longest number converted by read_number() itself */
+#define EXACT_DIGITS 15
+
+/* Characters a decimal number can start with, as field_number() reads it */
+static const BOOL number_start[256] =
+{
+    ['+'] = TRUE, ['-'] = TRUE, ['.'] = TRUE, ['0'] = TRUE, ['1'] = TRUE,
+    ['2'] = TRUE, ['3'] = TRUE, ['4'] = TRUE, ['5'] = TRUE, ['6'] = TRUE,
+    ['7'] = TRUE, ['8'] = TRUE, ['9'] = TRUE, [' '] = TRUE, ['\t'] = TRUE,
+    ['"'] = TRUE
+};
+
+/*
+ * Characters that can follow the digits a number starts with, as
+ * field_number() reads it: a fraction or an exponent goes on, and spaces,
+ * quotes or a NUL may end it. Anything else, a hex number too, leaves text
+ * over.
+ */
+static const BOOL number_next[256] =
+{
+    ['.'] = TRUE, ['e'] = TRUE, ['E'] = TRUE, [' '] = TRUE, ['\t'] = TRUE,
+    ['"'] = TRUE, [0] = TRUE
+};
+
+static const char* const labels[SUMMARY_LINES] =
+{
+    "count", "non-empty", "sum", "min", "max", "mean"
+};
+
+/* Whether field text has nothing to show: it is empty, or an empty quote */
+static BOOL
+is_empty(const uint8_t* text, size_t length)
+{
+    return !length || (length == 2 && text[0] == '"' && text[1] == '"');
+}
+
+/*
+ * Read field text as a number, with the same result as field_number(). The
+ * common case, at most EXACT_DIGITS digits with an optional sign and
+ * decimal point, is recognized from the digit mask of the classifier and
+ * converted here: the digits make an integer that a double holds exactly,
+ * and dividing it by a power of ten that a double holds too rounds just as
+ * strtod() does. Anything else (quotes, spaces, exponents, longer numbers)
+ * is left to field_number(). The classifier reads past the text, in place
+ * if readable bytes from text on belong to the record.
+ */
+static BOOL
+read_number(const uint8_t* text, size_t length, size_t readable,
+        double* number)
+{
+    uint8_t block[SCAN_DIGITSIZE];
+    size_t point = length;
+    size_t start = 0;
+    uint64_t mantissa = 0;
+    uint32_t digits;
+    uint32_t others;
+
+    /* Most text is told from a number by its first character, quoted or
+     * not */
+    if (!length || !number_start[text[0]]
+            || (text[0] == '"' && length > 1 && !number_start[text[1]]))
+        return FALSE;
+    if (length > SCAN_DIGITSIZE)
+        return field_number(text, length, number);
+
+    if (readable >= SCAN_DIGITSIZE)
+        digits = scan_digits(text);
+    else
+    {
+        memset(block, 0, sizeof(block));
+        memcpy(block, text, length);
+        digits = scan_digits(block);
+    }
+    digits &= (1U << length) - 1;
+    others = ((1U << length) - 1) & ~digits;
+    if (text[0] == '-' || text[0] == '+')
+    {
+        others &= ~1U;
+        start = 1;
+    }
+    if (others)
+    {
+        point = __builtin_ctz(others);
+        if (point > start && !number_next[text[point]])
+            return FALSE;
+        if (text[point] != '.' || (others & (others - 1)))
+            return field_number(text, length, number);
+    }
+    if (!digits)
+        return FALSE;
+    if (length - start - (point < length) > EXACT_DIGITS)
+        return field_number(text, length, number);
+
+    for (size_t i = start; i < point; i++)
+        mantissa = mantissa * 10 + (text[i] - '0');
+    for (size_t i = point + 1; i < length; i++)
+        mantissa = mantissa * 10 + (text[i] - '0');
+    *number = (double)mantissa;
+    if (point < length - 1)
+        *number /= powers_of_ten[length - 1 - point];
+    if (text[0] == '-')
+        *number = -*number;
+    return TRUE;
+}
+
+/*
+ * Add to the sum of column, keeping what rounding loses in error (Knuth's
+ * two-sum, which needs no branches), so that neither long columns nor the
+ * order the totals of -j workers are merged in make the sum drift
+ */
+static inline void
+add_sum(ColumnSummary* column, double number)
+{
+    double sum = column->sum + number;
+    double part = sum - column->sum;
+
+    column->error += (column->sum - (sum - part)) + (number - part);
+    column->sum = sum;
+}
+
+void
+summary_init(Summary* summary, size_t columns)
+{
+    summary->count = columns;
+    CALLOC(summary->columns, ColumnSummary, columns)
+    for (size_t i = 0; i < columns; i++)
+    {
+        summary->columns[i].min = INFINITY;
+        summary->columns[i].max = -INFINITY;
+    }
+}
+
+/* Count the fields of a row in the columns they are shown in */
+void
+summary_add(Summary* summary, const uint8_t* record, size_t record_len,
+        const FieldList* list)
+{
+    size_t count = list->count < summary->count ? list->count
+        : summary->count;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        ColumnSummary* column = summary->columns + i;
+        size_t offset = list->fields[i].offset;
+        const uint8_t* text = record + offset;
+        size_t length = list->fields[i].length;
+        double number;
+
+        column->count++;
+        if (is_empty(text, length))
+            continue;
+        column->filled++;
+        if (!read_number(text, length, record_len - offset, &number))
+            continue;
+
+        add_sum(column, number);
+        column->min = number < column->min ? number : column->min;
+        column->max = number > column->max ? number : column->max;
+        column->numbers++;
+    }
+}
+
+/* Add the totals of part, counted separately, to summary */
+void
+summary_merge(Summary* summary, const Summary* part)
+{
+    for (size_t i = 0; i < summary->count && i < part->count; i++)
+    {
+        ColumnSummary* column = summary->columns + i;
+        const ColumnSummary* other = part->columns + i;
+
+        column->count += other->count;
+        column->filled += other->filled;
+        if (!other->numbers)
+            continue;
+
+        add_sum(column, other->sum);
+        column->error += other->error;
+        column->min = other->min < column->min ? other->min : column->min;
+        column->max = other->max > column->max ? other->max : column->max;
+        column->numbers += other->numbers;
+    }
+}
+
+/*
+ * Write the text of the footer cell of column on line, a label and a value,
+ * into cell, which has room for SUMMARY_CELLSIZE bytes. Returns its length;
+ * the cell is left empty if the column holds no numbers to sum up.
+ */
+size_t
+summary_cell(const Summary* summary, UINT line, size_t column, uint8_t* cell)
+{
+    const ColumnSummary* c = summary->columns + column;
+    double sum = isfinite(c->sum) ? c->sum + c->error : c->sum;
+    double value;
+    int length;
+
+    if (line == SUMMARY_COUNT || line == SUMMARY_FILLED)
+        length = snprintf((char*)cell, SUMMARY_CELLSIZE, "%s=%zu",
+                labels[line], line == SUMMARY_COUNT ? c->count : c->filled);
+    else
+    {
+        if (!c->numbers)
+            return 0;
+        if (line == SUMMARY_SUM)
+            value = sum;
+        else if (line == SUMMARY_MIN)
+            value = c->min;
+        else if (line == SUMMARY_MAX)
+            value = c->max;
+        else
+            value = sum / c->numbers;
+        length = snprintf((char*)cell, SUMMARY_CELLSIZE, "%s=%.15g",
+                labels[line], value);
+    }
+    return length < SUMMARY_CELLSIZE ? (size_t)length : SUMMARY_CELLSIZE - 1;
+}
+
+void
+summary_free(Summary* summary)
+{
+    free(summary->columns);
+    summary->columns = NULL;
+    summary->count = 0;
+}
@@ -0,0 +1,67 @@
+/*
+ *    table - Command line utility to format and display CSV.
+ *    Copyright (C) 2020  Страхиња Радић
+ *
+ *    This program is free software: you can redistribute it and/or modify it
+ *    under the terms of the GNU General Public License as published by the Free
+ *    Software Foundation, either version 3 of the License, or (at your option)
+ *    any later version.
+ *
+ *    This program is distributed in the hope that it will be useful, but
+ *    WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *    or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *    for more details.
+ *
+ *    You should have received a copy of the GNU General Public License along
+ *    with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __SUMMARY_H
+#define __SUMMARY_H
+
+#include "defs.h"
+#include "parse.h"
+
+/* Lines of the --summary footer, in the order they are shown */
+enum
+{
+    SUMMARY_COUNT,  /* rows with the column */
+    SUMMARY_FILLED, /* of those, the ones with text in it */
+    SUMMARY_SUM,    /* of those, the ones holding a number */
+    SUMMARY_MIN,
+    SUMMARY_MAX,
+    SUMMARY_MEAN,
+    SUMMARY_LINES
+};
+
+/* Longest text of a footer cell, with its label */
+#define SUMMARY_CELLSIZE 64
+
+typedef struct
+{
+    size_t count;
+    size_t filled;
+    size_t numbers;
+    double sum;
+    double error;   /* what the rounding of sum lost, added back at the end */
+    double min;
+    double max;
+} ColumnSummary;
+
+/* Totals of the rows shown, column by column */
+typedef struct
+{
+    ColumnSummary* columns;
+    size_t         count;
+} Summary;
+
+void summary_init(Summary* summary, size_t columns);
+void summary_add(Summary* summary, const uint8_t* record, size_t record_len,
+        const FieldList* list);
+void summary_merge(Summary* summary, const Summary* part);
+size_t summary_cell(const Summary* summary, UINT line, size_t column,
+        uint8_t* cell);
+void summary_free(Summary* summary);
+
+#endif
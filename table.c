@@ -18,57 +18,19 @@
  */
 
 #include "defs.h"
+#include "index.h"
+#include "input.h"
+#include "parallel.h"
+#include "render.h"
 
-#define CHECKEXITNOMEM(ptr) { if (!ptr) exit(error(ENOMEM, \
-                (uint8_t*)"Memory allocation failed (out of memory?)")); }
-
-#define CALLOC(ptr, ptrtype, nmemb) { ptr = calloc(nmemb, sizeof(ptrtype)); \
-    CHECKEXITNOMEM(ptr) }
-
-#define REALLOC(ptr, ptrtype, newsize) { ptrtype* newptr = realloc(ptr, newsize); \
-    CHECKEXITNOMEM(newptr) \
-    ptr = newptr; }
-
-#define REALLOCARRAY(ptr, membtype, newcount) \
-    REALLOC(ptr, membtype, sizeof(membtype) * newcount)
-
-#define CHECKCOPY(token, ptoken, token_size, parg) { \
-    if (ptoken + 2 > token + token_size) \
-    { \
-        size_t old_size = token_size; \
-        token_size += BUFSIZE; \
-        REALLOC(token, char, token_size) \
-        ptoken = token + old_size - 1; \
-    } \
-    *ptoken++ = *parg++; }
-
-#define CHECKSET(format, pformat, format_size, num) { \
-    if (pformat + 2 > format + format_size) \
-    { \
-        size_t old_size = format_size; \
-        format_size += BUFSIZE; \
-        REALLOC(format, ULONG, format_size) \
-        pformat = format + old_size - 1; \
-    } \
-    *pformat++ = num; }
-
-size_t colno                  = 0;
-size_t lineno                 = 0;
-int current_symbol_set        = TABLE_SYMBOLS_DOUBLE;
-int current_inner_symbol_set  = TABLE_INNER_DOUBLE_SINGLE;
-size_t current_table_column   = 0;
-size_t current_rune_column    = 0;
-size_t table_columns          = 0;
-size_t rune_columns           = 80;
-size_t tab_length             = 8;
-ucs4_t delimiter              = ',';
+TableOptions options;
 ULONG* format                 = NULL;
 size_t format_size            = 0;
-ULONG format_value            = 0;
-BOOL border_mode              = FALSE;
-BOOL handle_ansi              = TRUE;
-BOOL msdos                    = FALSE;
-BOOL expand_tabs              = FALSE;
+BOOL follow                   = FALSE;
+BOOL show_stats               = FALSE;
+BOOL stats_json               = FALSE;
+BOOL titles                   = FALSE;
+size_t index_stride           = ROW_INDEX_STRIDE;
 
 int
 version()
@@ -80,26 +42,26 @@ version()
 int
 usage()
 {
-    printf("Usage: %s [-b|--border-mode] [-c <cols>|--columns=<cols>] [-d"
-            " <delim>|--delimiter=<delim>] [-f <format>|--format=<format>]"
-            " [-h|--help] [-m|--msdos] [-n|--no-ansi]"
-            " [-s <set>|--symbols=<set>] [-t|--expand-tabs] [-v|--version]\n",
+    printf("Usage: %s [-a|--auto-fit] [-b|--border-mode]"
+            " [-c <cols>|--columns=<cols>] [-d <delim>|--delimiter=<delim>]"
+            " [--ellipsis[=<marker>]]"
+            " [--exact-fit] [-f <format>|--format=<format>] [--follow]"
+            " [-h|--help] [--head=<rows>] [--index-stride=<rows>]"
+            " [--invalid=pass|replace|error]"
+            " [-j <jobs>|--jobs=<jobs>] [-m|--msdos] [--max-bytes=<bytes>]"
+            " [--max-time=<ms>]"
+            " [-n|--no-ansi] [--repeat-header=<rows>]"
+            " [--row-separators] [--rows=<start>[:<count>]]"
+            " [--sample-bytes=<bytes>] [--sample-rows=<rows>]"
+            " [--select=<cols>] [--sort=<keys>] [--sort-memory=<bytes>]"
+            " [--stats[=text|json]] [--strict] [--summary]"
+            " [-s <set>|--symbols=<set>] [--tail=<rows>]"
+            " [-t|--expand-tabs] [--title]"
+            " [-v|--version] [--where=<expr>] [<file>...]\n",
                 PROGRAMNAME);
     return 0;
 }
 
-int
-error(int code, uint8_t* fmt, ...)
-{
-    uint8_t    buf[BUFSIZE];
-    va_list args;
-    va_start(args, fmt);
-    u8_vsnprintf(buf, sizeof(buf), (const char*)fmt, args);
-    va_end(args);
-    fprintf(stderr, "%s: %s\n", PROGRAMNAME, buf);
-    return code;
-}
-
 char*
 substr(const char* src, int start, int finish)
 {
@@ -134,38 +96,10 @@ startswith(const char* s, const char* what)
 }
 
 int
-set_symbol_set(char* arg, int* current_symbol_set,
-               int* current_inner_symbol_set)
+set_symbol_set(char* arg, TableOptions* options)
 {
-    if (!strcmp(arg, "aa"))
-    {
-        *current_symbol_set = TABLE_SYMBOLS_ASCII;
-        *current_inner_symbol_set = TABLE_INNER_ASCII_ASCII;
-    }
-    else if (!strcmp(arg, "ss"))
-    {
-        *current_symbol_set = TABLE_SYMBOLS_SINGLE;
-        *current_inner_symbol_set = TABLE_INNER_SINGLE_SINGLE;
-    }
-    else if (!strcmp(arg, "sd"))
-    {
-        *current_symbol_set = TABLE_SYMBOLS_SINGLE;
-        *current_inner_symbol_set = TABLE_INNER_SINGLE_DOUBLE;
-    }
-    else if (!strcmp(arg, "ds"))
-    {
-        *current_symbol_set = TABLE_SYMBOLS_DOUBLE;
-        *current_inner_symbol_set = TABLE_INNER_DOUBLE_SINGLE;
-    }
-    else if (!strcmp(arg, "dd"))
-    {
-        *current_symbol_set = TABLE_SYMBOLS_DOUBLE;
-        *current_inner_symbol_set = TABLE_INNER_DOUBLE_DOUBLE;
-    }
-    else
-    {
-        return error(1, (uint8_t*)"Invalid symbol set: %s", arg);
-    }
+    if (table_set_symbols(options, arg))
+        return table_report(1, (uint8_t*)"Invalid symbol set: %s", arg);
     return 0;
 }
 
@@ -174,12 +108,36 @@ set_columns(const char* arg, size_t* cols)
 {
     size_t c = strtol(arg, NULL, 10);
     if (errno == EINVAL || errno == ERANGE)
-        return error(1, (uint8_t*)"Invalid numeric value: %s", arg);
+        return table_report(1, (uint8_t*)"Invalid numeric value: %s", arg);
     else
         *cols = c;
     return 0;
 }
 
+/* Parse start[:count]; count is unlimited if left out */
+int
+set_rows(const char* arg, size_t* start, size_t* count)
+{
+    char* end = NULL;
+
+    errno = 0;
+    *start = strtoul(arg, &end, 10);
+    if (errno || end == arg || !*start)
+        return 1;
+    *count = SIZE_MAX;
+    if (*end == ':' && *(end+1))
+    {
+        arg = end+1;
+        *count = strtoul(arg, &end, 10);
+        if (errno || end == arg)
+            return 1;
+    }
+    else if (*end == ':')
+        end++;
+
+    return *end ? 1 : 0;
+}
+
 int
 set_delimiter(uint8_t* arg, ucs4_t* delimiter)
 {
@@ -274,54 +232,92 @@ set_format(const char* arg, ULONG** format, size_t* format_size)
     return 0;
 }
 
-/* Return number of columns based on the input line */
-size_t
-number_of_columns(const uint8_t* input, ucs4_t delimiter)
+/*
+ * Render filename, or standard input if it is NULL, to standard output or,
+ * if write is given, through it. Returns the status to exit with.
+ */
+static int
+render_file(const char* filename, TableWriteFunc write, void* user)
 {
-    ucs4_t uch;
-    size_t ch_len = 0;
-    size_t result = 1;
-    const uint8_t* pinput = NULL;
-    size_t input_len = 0;
+    Input input;
+    if (input_open(&input, filename, follow))
+        return ENOENT;
+    input.delimiter = options.delimiter;
+    if (options.max_time)
+        input_set_deadline(&input, options.max_time);
+
+    Table* table = table_new(&options, write, user);
+    RowIndex index;
+    int status;
+
+    memset(&index, 0, sizeof(RowIndex));
+    /* Sorted rows are counted in sorted order, which no index knows */
+    if (options.rows_start > 1 && input.mapped && !options.sort)
+    {
+        row_index_open(&index, filename, &input, index_stride,
+                options.delimiter, table_next_record);
+        table->index = &index;
+    }
 
-    if (!input)
-        return result;
+    /* Show every row as soon as it has been read */
+    if (follow)
+        table->out.line_flush = TRUE;
 
-    input_len = u8_strlen(input);
-    pinput = input;
+    table_render_input(table, &input);
 
-    while (pinput && *pinput)
-    {
-        ch_len = u8_mbtouc(&uch, pinput, input_len);
-        if (uch == delimiter)
-            result++;
-        pinput += ch_len;
-    }
+    input_close(&input);
+    row_index_free(&index);
 
-    return result;
+    status = table_finish(table);
+    if (status)
+        table_report(status, (uint8_t*)"%s", table_error(table));
+    table_free(table);
+
+    return status;
 }
 
-UINT round_div(UINT a, UINT b)
+/* The name of a file on a line of its own, above its table */
+static void
+write_title(Output* out, const char* filename)
 {
-    return (a + (b/2)) / b;
+    output_string(out, (const uint8_t*)filename);
+    output_newline(out);
+    output_flush(out);
 }
 
-BOOL
-within_column(size_t column_start)
+/* Render file number index of the list in context, after a blank line */
+static int
+render_job(void* context, size_t index, OutputFunc write, void* user)
 {
-    return format 
-        ? (current_rune_column <
-            column_start + *(format+current_table_column))
-        : (current_rune_column <
-            column_start + format_value);
+    char** filenames = context;
+
+    if (index || titles)
+    {
+        Output out;
+
+        output_init_func(&out, write, user);
+        if (index)
+            output_newline(&out);
+        if (titles)
+            write_title(&out, filenames[index]);
+        output_free(&out);
+    }
+
+    return render_file(filenames[index], write, user);
 }
 
-int
-main(int argc, char** argv)
+/*
+ * Everything main() does with the arguments in argv, the files among them
+ * gathered in filenames; returns the exit status
+ */
+static int
+run(char** argv, char** filenames)
 {
     char* arg;
     Command cmd      = CMD_NONE;
-    char* filename   = NULL;
+    size_t files     = 0;
+
+    table_options_init(&options);
 
     while ((arg = *++argv))
     {
@@ -333,58 +329,215 @@ main(int argc, char** argv)
             {
                 if (!strcmp(arg, "version"))
                     cmd = CMD_VERSION;
+                else if (startswith(arg, "auto-fit"))
+                {
+                    arg += strlen("auto-fit");
+                    options.auto_fit = TRUE;
+                }
                 else if (startswith(arg, "border-mode"))
                 {
                     arg += strlen("border-mode");
-                    border_mode = TRUE;
+                    options.border_mode = TRUE;
                 }
                 else if (startswith(arg, "columns="))
                 {
                     arg += strlen("columns=");
-                    if (set_columns(arg, &rune_columns))
-                        return error(EINVAL, (uint8_t*)"Invalid argument: '%s'",
-                                arg);
+                    if (set_columns(arg, &options.columns))
+                        return table_report(EINVAL,
+                                (uint8_t*)"Invalid argument: '%s'", arg);
                 }
                 else if (startswith(arg, "delimiter="))
                 {
                     arg += strlen("delimiter=");
-                    if (set_delimiter((uint8_t*)arg, &delimiter))
-                        return error(EINVAL, (uint8_t*)"Invalid argument: '%s'",
-                                arg);
+                    if (set_delimiter((uint8_t*)arg, &options.delimiter))
+                        return table_report(EINVAL,
+                                (uint8_t*)"Invalid argument: '%s'", arg);
+                }
+                else if (startswith(arg, "ellipsis"))
+                {
+                    arg += strlen("ellipsis");
+                    if (!*arg)
+                        options.ellipsis = "\u2026";
+                    else if (*arg == '=')
+                        options.ellipsis = arg + 1;
+                    else
+                        return table_report(EINVAL,
+                                (uint8_t*)"Invalid argument: '%s'", arg);
+                }
+                else if (startswith(arg, "exact-fit"))
+                {
+                    arg += strlen("exact-fit");
+                    options.auto_fit = TRUE;
+                    options.exact_fit = TRUE;
                 }
                 else if (startswith(arg, "expand-tabs"))
                 {
                     arg += strlen("expand-tabs");
-                    expand_tabs = TRUE;
+                    options.expand_tabs = TRUE;
+                }
+                else if (startswith(arg, "follow"))
+                {
+                    arg += strlen("follow");
+                    follow = TRUE;
                 }
                 else if (startswith(arg, "format="))
                 {
                     arg += strlen("format=");
                     set_format(arg, &format, &format_size);
                 }
+                else if (startswith(arg, "head="))
+                {
+                    arg += strlen("head=");
+                    if (set_columns(arg, &options.head_rows))
+                        return table_report(EINVAL,
+                                (uint8_t*)"Invalid argument: '%s'", arg);
+                }
+                else if (startswith(arg, "index-stride="))
+                {
+                    arg += strlen("index-stride=");
+                    if (set_columns(arg, &index_stride))
+                        return table_report(EINVAL,
+                                (uint8_t*)"Invalid argument: '%s'", arg);
+                }
+                else if (startswith(arg, "invalid="))
+                {
+                    arg += strlen("invalid=");
+                    if (table_set_invalid(&options, arg))
+                        return table_report(EINVAL,
+                                (uint8_t*)"Invalid argument: '%s'", arg);
+                }
+                else if (startswith(arg, "jobs="))
+                {
+                    arg += strlen("jobs=");
+                    if (set_columns(arg, &options.jobs))
+                        return table_report(EINVAL,
+                                (uint8_t*)"Invalid argument: '%s'", arg);
+                }
+                else if (startswith(arg, "max-bytes="))
+                {
+                    arg += strlen("max-bytes=");
+                    if (set_columns(arg, &options.max_bytes))
+                        return table_report(EINVAL,
+                                (uint8_t*)"Invalid argument: '%s'", arg);
+                }
+                else if (startswith(arg, "max-time="))
+                {
+                    arg += strlen("max-time=");
+                    if (set_columns(arg, &options.max_time))
+                        return table_report(EINVAL,
+                                (uint8_t*)"Invalid argument: '%s'", arg);
+                }
                 else if (startswith(arg, "msdos"))
                 {
                     arg += strlen("msdos");
-                    msdos = TRUE;
                 }
                 else if (startswith(arg, "no-ansi"))
                 {
                     arg += strlen("no-ansi");
-                    handle_ansi = FALSE;
+                    options.bold_header = FALSE;
+                }
+                else if (startswith(arg, "repeat-header="))
+                {
+                    arg += strlen("repeat-header=");
+                    if (set_columns(arg, &options.repeat_header))
+                        return table_report(EINVAL,
+                                (uint8_t*)"Invalid argument: '%s'", arg);
+                }
+                else if (!strcmp(arg, "row-separators"))
+                    options.row_separators = TRUE;
+                else if (startswith(arg, "rows="))
+                {
+                    arg += strlen("rows=");
+                    if (set_rows(arg, &options.rows_start, &options.rows_count))
+                        return table_report(EINVAL,
+                                (uint8_t*)"Invalid argument: '%s'", arg);
+                }
+                else if (startswith(arg, "sample-bytes="))
+                {
+                    arg += strlen("sample-bytes=");
+                    if (set_columns(arg, &options.sample_bytes))
+                        return table_report(EINVAL,
+                                (uint8_t*)"Invalid argument: '%s'", arg);
+                }
+                else if (startswith(arg, "sample-rows="))
+                {
+                    arg += strlen("sample-rows=");
+                    if (set_columns(arg, &options.sample_rows))
+                        return table_report(EINVAL,
+                                (uint8_t*)"Invalid argument: '%s'", arg);
+                }
+                else if (startswith(arg, "select="))
+                {
+                    arg += strlen("select=");
+                    if (!*arg)
+                        return table_report(EINVAL,
+                                (uint8_t*)"Invalid argument: '%s'", arg);
+                    options.select = arg;
+                }
+                else if (startswith(arg, "sort="))
+                {
+                    arg += strlen("sort=");
+                    if (!*arg)
+                        return table_report(EINVAL,
+                                (uint8_t*)"Invalid argument: '%s'", arg);
+                    options.sort = arg;
                 }
+                else if (startswith(arg, "sort-memory="))
+                {
+                    arg += strlen("sort-memory=");
+                    if (set_columns(arg, &options.sort_memory))
+                        return table_report(EINVAL,
+                                (uint8_t*)"Invalid argument: '%s'", arg);
+                }
+                else if (startswith(arg, "stats"))
+                {
+                    arg += strlen("stats");
+#ifndef TABLE_STATS
+                    return table_report(EINVAL,
+                            (uint8_t*)"--stats needs a build with TABLE_STATS"
+                            " (redo table-stats)");
+#endif
+                    if (!strcmp(arg, "=json"))
+                        stats_json = TRUE;
+                    else if (*arg && strcmp(arg, "=text"))
+                        return table_report(EINVAL,
+                                (uint8_t*)"Invalid argument: '%s'", arg);
+                    show_stats = TRUE;
+                }
+                else if (!strcmp(arg, "strict"))
+                    options.strict = TRUE;
+                else if (!strcmp(arg, "summary"))
+                    options.summary = TRUE;
                 else if (startswith(arg, "symbols="))
                 {
                     arg += strlen("symbols=");
-                    if (set_symbol_set(arg, &current_symbol_set,
-                                &current_inner_symbol_set))
-                        return error(EINVAL, (uint8_t*)"Invalid argument: '%s'",
-                                arg);
+                    if (set_symbol_set(arg, &options))
+                        return table_report(EINVAL,
+                                (uint8_t*)"Invalid argument: '%s'", arg);
+                }
+                else if (!strcmp(arg, "title"))
+                    titles = TRUE;
+                else if (startswith(arg, "tail="))
+                {
+                    arg += strlen("tail=");
+                    if (set_columns(arg, &options.tail_rows))
+                        return table_report(EINVAL,
+                                (uint8_t*)"Invalid argument: '%s'", arg);
+                }
+                else if (startswith(arg, "where="))
+                {
+                    arg += strlen("where=");
+                    if (!*arg)
+                        return table_report(EINVAL,
+                                (uint8_t*)"Invalid argument: '%s'", arg);
+                    options.where = arg;
                 }
                 else if (!strcmp(arg, "help"))
                     return usage();
                 else
                 {
-                    error(EINVAL, (uint8_t*)"Invalid argument: --%s", arg);
+                    table_report(EINVAL,
+                            (uint8_t*)"Invalid argument: --%s", arg);
                     return usage();
                 }
             }
@@ -392,8 +545,11 @@ main(int argc, char** argv)
             {
                 switch (c)
                 {
+                case 'a':
+                    options.auto_fit = TRUE;
+                    break;
                 case 'b':
-                    border_mode = TRUE;
+                    options.border_mode = TRUE;
                     break;
                 case 'c':
                     cmd = CMD_COLUMNS;
@@ -407,23 +563,25 @@ main(int argc, char** argv)
                 case 'h':
                     return usage();
                     break;
+                case 'j':
+                    cmd = CMD_JOBS;
+                    break;
                 case 'm':
-                    msdos = TRUE;
                     break;
                 case 'n':
-                    handle_ansi = FALSE;
+                    options.bold_header = FALSE;
                     break;
                 case 's':
                     cmd = CMD_SYMBOLS;
                     break;
                 case 't':
-                    expand_tabs = TRUE;
+                    options.expand_tabs = TRUE;
                     break;
                 case 'v':
                     cmd = CMD_VERSION;
                     break;
                 default:
-                    error(EINVAL, (uint8_t*)"Invalid argument: -%c", c);
+                    table_report(EINVAL, (uint8_t*)"Invalid argument: -%c", c);
                     return usage();
                 }
             }
@@ -432,27 +590,36 @@ main(int argc, char** argv)
         {
             if (cmd == CMD_COLUMNS)
             {
-                if (set_columns(arg, &rune_columns))
-                    return error(EINVAL, (uint8_t*)"Invalid argument: '%s'", arg);
+                if (set_columns(arg, &options.columns))
+                    return table_report(EINVAL,
+                            (uint8_t*)"Invalid argument: '%s'", arg);
             }
             else if (cmd == CMD_DELIMITER)
             {
-                if (set_delimiter((uint8_t*)arg, &delimiter))
-                    return error(EINVAL, (uint8_t*)"Invalid argument: '%s'", arg);
+                if (set_delimiter((uint8_t*)arg, &options.delimiter))
+                    return table_report(EINVAL,
+                            (uint8_t*)"Invalid argument: '%s'", arg);
             }
             else if (cmd == CMD_FORMAT)
             {
                 if (set_format(arg, &format, &format_size))
-                    return error(EINVAL, (uint8_t*)"Invalid argument: '%s'", arg);
+                    return table_report(EINVAL,
+                            (uint8_t*)"Invalid argument: '%s'", arg);
+            }
+            else if (cmd == CMD_JOBS)
+            {
+                if (set_columns(arg, &options.jobs))
+                    return table_report(EINVAL,
+                            (uint8_t*)"Invalid argument: '%s'", arg);
             }
             else if (cmd == CMD_SYMBOLS)
             {
-                if (set_symbol_set(arg, &current_symbol_set,
-                            &current_inner_symbol_set))
-                    return error(EINVAL, (uint8_t*)"Invalid argument: '%s'", arg);
+                if (set_symbol_set(arg, &options))
+                    return table_report(EINVAL,
+                            (uint8_t*)"Invalid argument: '%s'", arg);
             }
             else
-                filename = arg;
+                filenames[files++] = arg;
             cmd = CMD_NONE;
         }
     }
@@ -460,289 +627,68 @@ main(int argc, char** argv)
     if (cmd == CMD_VERSION)
         return version();
 
-    FILE* input = NULL;
-    if (filename)
-    {
-        input = fopen(filename, "r");
-        if (!input)
-            return error(ENOENT, (uint8_t*)"File not found: %s", filename);
-    }
-    else
-        input = stdin;
-
-    uint8_t* line                  = NULL;
-    size_t pline_len               = 0;
-    uint8_t* pline                 = NULL;
-    BOOL quote                     = FALSE;
-    ucs4_t uch;
-    size_t ch_len                  = 0;
-    size_t output_lines            = 0;
-    size_t column_start            = 0;
-
-    CALLOC(line, uint8_t, BUFSIZE)
-
-    while (!feof(input))
-    {
-        char* eol = NULL;
-        if (!fgets((char*)line, sizeof(uint8_t) * BUFSIZE-1, input))
-            break;
-
-        eol = strchr((char*)line, '\n');
-        if (eol)
-        {
-            if (msdos && *line != '\n' && *(eol-1) == '\r')
-                *(eol-1) = 0;
-            *eol = 0;
-        }
-
-        if (!*line)
-            continue;
-
-        quote = FALSE;
-        pline = line;
-        colno = 0;
-        current_rune_column = 0;
-
-        /* Top border */
-        if (lineno == 0)
-        {
-            if (!border_mode)
-                table_columns = number_of_columns(line, delimiter);
-            else
-                table_columns = 1;
-
-            /* Sanity check */
-            if (rune_columns < table_columns+2)
-                rune_columns = table_columns+2;
-
-            if (format && !border_mode)
-            {
-                ULONG* pformat = format;
-                ULONG format_sum = 0;
-                while (*pformat)
-                    format_sum += *pformat++;
-                pformat = format;
-                while (*pformat && format_sum)
-                {
-                    *pformat = round_div((rune_columns-table_columns-2) 
-                            * (*pformat), format_sum);
-                    pformat++;
-                }
-            }
-            else
-                format_value = (rune_columns-table_columns-2) / table_columns;
-
-            current_table_column = 0;
-            column_start = 0;
-            while (current_table_column < table_columns)
-            {
-                if (current_rune_column == 0)
-                {
-                    printf("%s", table_symbols[current_symbol_set][0]);
-                    column_start++;
-                }
-                else if (!within_column(column_start))
-                {
-                    if (current_table_column == table_columns-1)
-                    {
-                        printf("%s", table_symbols[current_symbol_set][2]);
-                        current_table_column++;
-                    }
-                    else
-                    {
-                        printf("%s", table_inner_symbols[current_inner_symbol_set][0]);
-                        column_start++;
-                        if (format)
-                            column_start += *(format+current_table_column);
-                        else
-                            column_start += format_value;
-                        current_table_column++;
-                    }
-                }
-                else
-                    printf("%s", table_symbols[current_symbol_set][1]);
-                current_rune_column++;
-            }
-            printf("\n");
-            output_lines++;
-        }
+    if (follow && options.sort)
+        return table_report(EINVAL, (uint8_t*)"--sort needs the whole input,"
+                " so it cannot be used with --follow");
 
-        /* Inner rows */
-        current_table_column = 0;
-        current_rune_column = 0;
-        column_start = 0;
+    if (follow && files > 1)
+        return table_report(EINVAL, (uint8_t*)"--follow takes a single file");
 
-        printf("%s", table_symbols[current_symbol_set][3]);
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
 
-        if (handle_ansi && lineno == 0)
-            printf("%s", ANSI_SGR_BOLD_ON);
+    options.format = format;
+    int status;
 
-        while (pline && *pline)
+    if (files > 1)
+    {
+        /* Each file is rendered whole by one of the -j workers */
+        size_t jobs = parallel_jobs(options.jobs);
+        Output out;
+
+        options.jobs = 1;
+        output_init(&out, STDOUT_FILENO);
+        status = render_ordered(files, jobs, render_job, filenames, &out);
+        output_free(&out);
+    }
+    else
+    {
+        if (titles && files)
         {
-            if (*pline == '"')
-            {
-                quote = !quote;
-                pline++;
-                colno++;
-            }
-            else
-            {
-                uint8_t* pch_end;
-                pline_len = u8_strlen(line);
-                ch_len = u8_mbtouc(&uch, pline, pline_len);
-                if (border_mode)
-                {
-                    pch_end = pline + ch_len;
-                    if (within_column(column_start))
-                    {
-                        while (pline != pch_end)
-                            printf("%c", *pline++);
-                        current_rune_column++;
-                    }
-                    pline = pch_end;
-                    colno += ch_len;
-                }
-                else if (ch_len <= 0)
-                {
-                    if (within_column(column_start))
-                    {
-                        printf("%c", *pline++);
-                        current_rune_column++;
-                    }
-                    colno++;
-                }
-                else if (uch == '\t' && expand_tabs)
-                {
-                    while (within_column(column_start))
-                    {
-                        printf(" ");
-                        current_rune_column++;
-                        if (current_rune_column % tab_length == 0)
-                            break;
-                    }
-                    pline++;
-                    colno++;
-                }
-                else if (uch == delimiter && !quote 
-                        && current_table_column < table_columns-1)
-                {
-                    if (handle_ansi && lineno == 0)
-                        printf("%s", ANSI_SGR_BOLD_OFF);
-
-                    while (within_column(column_start))
-                    {
-                        printf(" ");
-                        current_rune_column++;
-                    }
-                    column_start++;
-                    if (format)
-                        column_start += *(format+current_table_column);
-                    else
-                        column_start += format_value;
-                    if (current_table_column != table_columns-1)
-                    {
-                        printf("%s", table_inner_symbols[current_inner_symbol_set][1]);
-                        current_rune_column++;
-                        current_table_column++;
-                    }
-
-                    if (handle_ansi && lineno == 0)
-                        printf("%s", ANSI_SGR_BOLD_ON);
-
-                    pline += ch_len;
-                    colno += ch_len;
-                }
-                else
-                {
-                    pch_end = pline + ch_len;
-                    if (within_column(column_start))
-                    {
-                        while (pline != pch_end)
-                            printf("%c", *pline++);
-                        current_rune_column++;
-                    }
-                    pline = pch_end;
-                    colno += ch_len;
-                }
-            }
-        }
-
-        if (handle_ansi && lineno == 0)
-            printf("%s", ANSI_SGR_BOLD_OFF);
+            Output out;
 
-        while (current_table_column < table_columns-1)
-        {
-            while (within_column(column_start))
-            {
-                printf(" ");
-                current_rune_column++;
-            }
-            printf("%s", table_inner_symbols[current_inner_symbol_set][1]);
-            column_start++;
-            if (format)
-                column_start += *(format+current_table_column);
-            else
-                column_start += format_value;
-            current_table_column++;
-            current_rune_column++;
+            output_init(&out, STDOUT_FILENO);
+            write_title(&out, filenames[0]);
+            output_free(&out);
         }
-        while (within_column(column_start))
-        {
-            printf(" ");
-            current_rune_column++;
-        }
-
-        printf("%s\n", table_symbols[current_symbol_set][5]);
-
-        output_lines++;
-        lineno++;
+        status = render_file(files ? filenames[0] : NULL, NULL, NULL);
     }
 
-    fclose(input);
-    free(line);
-
-    /* Bottom border */
-    if (output_lines)
+#ifdef TABLE_STATS
+    if (show_stats)
     {
-        current_table_column = 0;
-        current_rune_column = 0;
-        column_start = 0;
-        while (current_table_column < table_columns)
-        {
-            if (current_rune_column == 0)
-            {
-                printf("%s", table_symbols[current_symbol_set][6]);
-                column_start++;
-            }
-            else if (!within_column(column_start))
-            {
-                if (current_table_column == table_columns-1)
-                {
-                    printf("%s", table_symbols[current_symbol_set][8]);
-                    current_table_column++;
-                }
-                else
-                {
-                    printf("%s", table_inner_symbols[current_inner_symbol_set][2]);
-                    column_start++;
-                    if (format)
-                        column_start += *(format+current_table_column);
-                    else
-                        column_start += format_value;
-                    current_table_column++;
-                }
-            }
-            else
-                printf("%s", table_symbols[current_symbol_set][7]);
-            current_rune_column++;
-        }
-        printf("\n");
-        output_lines++;
+        struct timespec end;
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        stats_print(stderr, stats_json, (end.tv_sec - start.tv_sec)
+                + (end.tv_nsec - start.tv_nsec) / 1e9);
     }
+#endif
+
+    return status;
+}
+
+int
+main(int argc, char** argv)
+{
+    char** filenames;
+    int status;
+
+    CALLOC(filenames, char*, argc)
+    status = run(argv, filenames);
 
     if (format)
         free(format);
+    free(filenames);
 
-    return 0;
+    return status;
 }
-
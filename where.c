@@ -0,0 +1,302 @@
+/*
+ *    table - Command line utility to format and display CSV.
+ *    Copyright (C) 2020  Страхиња Радић
+ *
+ *    This program is free software: you can redistribute it and/or modify it
+ *    under the terms of the GNU General Public License as published by the Free
+ *    Software Foundation, either version 3 of the License, or (at your option)
+ *    any later version.
+ *
+ *    This program is distributed in the hope that it will be useful, but
+ *    WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *    or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *    for more details.
+ *
+ *    You should have received a copy of the GNU General Public License along
+ *    with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "defs.h"
+#include "where.h"
+
+/* Fields this long or shorter are unquoted on the stack */
+#define WHERE_BUFSIZE 256
+
+static const char*
+skip_spaces(const char* s)
+{
+    while (*s == ' ' || *s == '\t')
+        s++;
+    return s;
+}
+
+/* Read the comparison at s into op; NULL if there is none */
+static const char*
+parse_operator(const char* s, UINT* op)
+{
+    static const struct
+    {
+        const char* name;
+        UINT op;
+    } operators[] = {
+        { "!=", WHERE_NOT_EQUAL }, { "^=", WHERE_PREFIX },
+        { "$=", WHERE_SUFFIX }, { "*=", WHERE_CONTAINS },
+        { "<=", WHERE_LESS_EQUAL }, { ">=", WHERE_GREATER_EQUAL },
+        { "=", WHERE_EQUAL }, { "<", WHERE_LESS }, { ">", WHERE_GREATER }
+    };
+
+    for (size_t i = 0; i < sizeof(operators) / sizeof(*operators); i++)
+        if (!strncmp(s, operators[i].name, strlen(operators[i].name)))
+        {
+            *op = operators[i].op;
+            return s + strlen(operators[i].name);
+        }
+    return NULL;
+}
+
+/*
+ * Read a value up to the next '&' or '|', or in double quotes (with ""
+ * for a quote) to keep spaces, '&' and '|'. Returns where it ends.
+ */
+static const char*
+parse_value(const char* s, Condition* condition)
+{
+    const char* start = s;
+    uint8_t* pvalue;
+    BOOL closed = FALSE;
+
+    if (*s != '"')
+    {
+        while (*s && *s != '&' && *s != '|')
+            s++;
+        condition->value_len = s - start;
+        while (condition->value_len && (start[condition->value_len-1] == ' '
+                    || start[condition->value_len-1] == '\t'))
+            condition->value_len--;
+        CALLOC(condition->value, uint8_t, condition->value_len + 1)
+        memcpy(condition->value, start, condition->value_len);
+        return s;
+    }
+
+    CALLOC(condition->value, uint8_t, strlen(s))
+    pvalue = condition->value;
+    for (s++; *s; s++)
+    {
+        if (*s == '"' && *++s != '"')
+        {
+            closed = TRUE;
+            break;
+        }
+        *pvalue++ = *s;
+    }
+    condition->value_len = pvalue - condition->value;
+    return closed ? s : NULL;
+}
+
+/*
+ * Parse a --where expression: conditions <column><comparison><value>,
+ * joined by '&' (and), which binds tighter than '|' (or). Returns 0, or
+ * EINVAL with bad pointing at the condition that could not be read.
+ */
+int
+where_parse(Where* where, const char* spec, const char** bad)
+{
+    const char* s = spec;
+    size_t size = 0;
+    BOOL alternative = TRUE;
+
+    memset(where, 0, sizeof(Where));
+    while (TRUE)
+    {
+        Condition* condition;
+        const char* start = skip_spaces(s);
+        const char* end = start + strcspn(start, "=!<>^$*&|");
+        size_t column_len = end - start;
+
+        *bad = start;
+        while (column_len && (start[column_len-1] == ' '
+                    || start[column_len-1] == '\t'))
+            column_len--;
+        if (!column_len)
+            return EINVAL;
+
+        if (where->count == size)
+        {
+            size = size ? size * 2 : 4;
+            REALLOCARRAY(where->conditions, Condition, size)
+        }
+        condition = where->conditions + where->count++;
+        memset(condition, 0, sizeof(Condition));
+        CALLOC(condition->column, char, column_len + 1)
+        memcpy(condition->column, start, column_len);
+        condition->alternative = alternative;
+
+        if (!(s = parse_operator(end, &condition->op))
+                || !(s = parse_value(skip_spaces(s), condition)))
+            return EINVAL;
+        if (condition->op >= WHERE_LESS
+                && !field_number(condition->value, condition->value_len,
+                    &condition->number))
+            return EINVAL;
+
+        s = skip_spaces(s);
+        if (!*s)
+            return 0;
+        if (*s != '&' && *s != '|')
+            return EINVAL;
+        alternative = *s++ == '|';
+    }
+}
+
+/*
+ * Find the columns compared in the header row, split into all of its
+ * fields: by number, counting from 1, or by name. Returns FALSE with
+ * missing set to a column that is not there.
+ */
+BOOL
+where_resolve(Where* where, const uint8_t* header, const FieldList* list,
+        const char** missing)
+{
+    for (size_t i = 0; i < where->count; i++)
+    {
+        Condition* condition = where->conditions + i;
+        size_t field = field_list_find(list, header, condition->column,
+                strlen(condition->column));
+
+        if (field >= list->count)
+        {
+            *missing = condition->column;
+            return FALSE;
+        }
+        condition->field = field;
+        if (field > where->last_field)
+            where->last_field = field;
+    }
+    return TRUE;
+}
+
+/* Whether value occurs in text */
+static BOOL
+contains(const uint8_t* text, size_t length, const uint8_t* value,
+        size_t value_len)
+{
+    const uint8_t* end = text + length;
+
+    if (!value_len)
+        return TRUE;
+    while (length >= value_len
+            && (text = memchr(text, value[0], length - value_len + 1)))
+    {
+        if (!memcmp(text, value, value_len))
+            return TRUE;
+        text++;
+        length = end - text;
+    }
+    return FALSE;
+}
+
+/*
+ * Compare the raw text of a field, after the quoting is taken out. Fields
+ * that are not numbers fail any numeric comparison.
+ */
+static BOOL
+holds(const Condition* condition, const uint8_t* text, size_t length)
+{
+    uint8_t buf[WHERE_BUFSIZE];
+    uint8_t* unquoted = NULL;
+    double number;
+    BOOL result = FALSE;
+
+    switch (condition->op)
+    {
+    case WHERE_EQUAL:
+        return field_equals(text, length, condition->value,
+                condition->value_len);
+    case WHERE_NOT_EQUAL:
+        return !field_equals(text, length, condition->value,
+                condition->value_len);
+    case WHERE_LESS:
+        return field_number(text, length, &number)
+            && number < condition->number;
+    case WHERE_LESS_EQUAL:
+        return field_number(text, length, &number)
+            && number <= condition->number;
+    case WHERE_GREATER:
+        return field_number(text, length, &number)
+            && number > condition->number;
+    case WHERE_GREATER_EQUAL:
+        return field_number(text, length, &number)
+            && number >= condition->number;
+    }
+
+    if (memchr(text, '"', length))
+    {
+        if (length > sizeof(buf))
+            CALLOC(unquoted, uint8_t, length)
+        length = field_unquote(text, length, unquoted ? unquoted : buf);
+        text = unquoted ? unquoted : buf;
+    }
+
+    switch (condition->op)
+    {
+    case WHERE_PREFIX:
+        result = length >= condition->value_len
+            && !memcmp(text, condition->value, condition->value_len);
+        break;
+    case WHERE_SUFFIX:
+        result = length >= condition->value_len
+            && !memcmp(text + length - condition->value_len,
+                    condition->value, condition->value_len);
+        break;
+    default:
+        result = contains(text, length, condition->value,
+                condition->value_len);
+    }
+
+    free(unquoted);
+    return result;
+}
+
+/*
+ * Whether a record, split at least up to the last column compared, passes.
+ * Columns the record does not have are empty. The conditions of an
+ * alternative are checked only as long as they hold.
+ */
+BOOL
+where_match(const Where* where, const uint8_t* record, const FieldList* list)
+{
+    BOOL match = FALSE;
+
+    for (size_t i = 0; i < where->count; i++)
+    {
+        const Condition* condition = where->conditions + i;
+        const Field* field = list->fields + condition->field;
+
+        if (condition->alternative)
+        {
+            if (match)
+                return TRUE;
+            match = TRUE;
+        }
+        else if (!match)
+            continue;
+
+        match = condition->field < list->count
+            ? holds(condition, record + field->offset, field->length)
+            : holds(condition, (const uint8_t*)"", 0);
+    }
+    return match;
+}
+
+void
+where_free(Where* where)
+{
+    for (size_t i = 0; i < where->count; i++)
+    {
+        free(where->conditions[i].column);
+        free(where->conditions[i].value);
+    }
+    free(where->conditions);
+    memset(where, 0, sizeof(Where));
+}
@@ -0,0 +1,70 @@
+/*
+ *    table - Command line utility to format and display CSV.
+ *    Copyright (C) 2020  Страхиња Радић
+ *
+ *    This program is free software: you can redistribute it and/or modify it
+ *    under the terms of the GNU General Public License as published by the Free
+ *    Software Foundation, either version 3 of the License, or (at your option)
+ *    any later version.
+ *
+ *    This program is distributed in the hope that it will be useful, but
+ *    WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *    or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *    for more details.
+ *
+ *    You should have received a copy of the GNU General Public License along
+ *    with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __WHERE_H
+#define __WHERE_H
+
+#include "defs.h"
+#include "parse.h"
+
+/* Comparisons of a --where condition */
+enum
+{
+    WHERE_EQUAL,         /* = */
+    WHERE_NOT_EQUAL,     /* != */
+    WHERE_PREFIX,        /* ^= */
+    WHERE_SUFFIX,        /* $= */
+    WHERE_CONTAINS,      /* *= */
+    WHERE_LESS,          /* < and the rest compare numbers */
+    WHERE_LESS_EQUAL,
+    WHERE_GREATER,
+    WHERE_GREATER_EQUAL
+};
+
+typedef struct
+{
+    char*    column;      /* as given: a number or a header name */
+    size_t   field;       /* source column, from 0, once resolved */
+    UINT     op;
+    uint8_t* value;       /* without the quoting */
+    size_t   value_len;
+    double   number;      /* value of a numeric comparison */
+    BOOL     alternative; /* first of an alternative, after '|' */
+} Condition;
+
+/*
+ * A --where expression: alternatives separated by '|', each of conditions
+ * that must all hold, separated by '&'
+ */
+typedef struct
+{
+    Condition* conditions;
+    size_t     count;
+    size_t     last_field; /* highest source column compared */
+} Where;
+
+int where_parse(Where* where, const char* spec, const char** bad);
+BOOL where_resolve(Where* where, const uint8_t* header, const FieldList* list,
+        const char** missing);
+BOOL where_match(const Where* where, const uint8_t* record,
+        const FieldList* list);
+void where_free(Where* where);
+
+#endif
+
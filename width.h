@@ -0,0 +1,50 @@
+/*
+ *    table - Command line utility to format and display CSV.
+ *    Copyright (C) 2020  Страхиња Радић
+ *
+ *    This program is free software: you can redistribute it and/or modify it
+ *    under the terms of the GNU General Public License as published by the Free
+ *    Software Foundation, either version 3 of the License, or (at your option)
+ *    any later version.
+ *
+ *    This program is distributed in the hope that it will be useful, but
+ *    WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *    or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *    for more details.
+ *
+ *    You should have received a copy of the GNU General Public License along
+ *    with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __WIDTH_H
+#define __WIDTH_H
+
+#include "defs.h"
+
+/* Code points per block of the width table, and number of blocks */
+#define WIDTH_BLOCK_SIZE 256
+#define WIDTH_INDEX_SIZE (0x110000 / WIDTH_BLOCK_SIZE)
+
+/* Generated into widthtab.c by mkwidth; 2 bits of width per code point */
+extern const UBYTE width_index[WIDTH_INDEX_SIZE];
+extern const UBYTE width_blocks[][WIDTH_BLOCK_SIZE / 4];
+
+/*
+ * Number of terminal columns taken by uc: 0 for combining and other
+ * non-spacing characters, 2 for East Asian wide and fullwidth ones.
+ * ASCII, control characters included, always takes one column.
+ */
+static inline int
+char_width(ucs4_t uc)
+{
+    if (uc < 0x80)
+        return 1;
+    if (uc >= 0x110000)
+        return 1;
+    return (width_blocks[width_index[uc / WIDTH_BLOCK_SIZE]]
+            [uc % WIDTH_BLOCK_SIZE / 4] >> (uc % 4 * 2)) & 3;
+}
+
+#endif
+